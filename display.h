@@ -0,0 +1,17 @@
+// Display that main.c sends rows of pixels to, implemented by the ST7789
+// driver on the Pico and by the board model on the host.
+//
+// Rows are sent on two channels in turn, so that one row can be built
+// while the other is sent, and each channel's pixels follow the other's.
+// Pixels are RGB565 converted by st7789_pixel, in word aligned rows of an
+// even number of pixels, and must stay unchanged until their channel is
+// no longer busy.
+typedef struct DisplayBackend {
+  void (*start_pixels)(struct DisplayBackend* d);  // Before the first row of frames
+  void (*stop_pixels)(struct DisplayBackend* d);   // After the last
+  void (*send_pixels)(struct DisplayBackend* d, uint chan_idx, const uint16_t* pixels, uint num_pixels);
+  void (*repeat_pixel)(struct DisplayBackend* d, uint chan_idx, uint16_t pixel, uint repeats);
+  bool (*is_busy)(struct DisplayBackend* d, uint chan_idx);
+  void (*wait_for_finish)(struct DisplayBackend* d, uint chan_idx);
+  void* state;  // For the implementation
+} DisplayBackend;
@@ -0,0 +1,327 @@
+// Host model of the board that main.c drives.  See host_board.h.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/uart.h"
+
+#include "mandelbrot.h"
+#include "input.h"
+#include "display.h"
+#include "host_board.h"
+#include "st7789_lcd.h"
+#include "nunchuck.h"
+
+#define SCREEN_WIDTH 240
+#define SCREEN_HEIGHT 240
+#define SCREEN_PIXELS (SCREEN_WIDTH * SCREEN_HEIGHT)
+
+// Depth of each direction of the inter-core FIFO
+#define FIFO_DEPTH 8
+
+HostBoardConfig host_board = { HOST_VIDEO_Y4M, 30, 0, 0, NULL };
+HostBoardStats host_board_stats;
+
+static FILE* video;
+static uint16_t frame[SCREEN_PIXELS];
+static uint32_t frame_pos;
+
+void stdio_init_all(void)
+{
+  fflush(stdout);
+  video = fdopen(dup(STDOUT_FILENO), "wb");
+  dup2(STDERR_FILENO, STDOUT_FILENO);
+  host_board_stats.start_us = time_us_64();
+}
+
+// Core 1 and the FIFOs.  fifo[n] is read by core n.
+typedef struct {
+  uint32_t data[FIFO_DEPTH];
+  int head, count;
+} Fifo;
+
+static Fifo fifo[2];
+static pthread_mutex_t fifo_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fifo_cond = PTHREAD_COND_INITIALIZER;
+static _Thread_local int core_num;
+static uint64_t core1_start_us;
+
+static void* core1_thread(void* entry)
+{
+  core_num = 1;
+  ((void (*)(void))entry)();
+  return NULL;
+}
+
+void multicore_launch_core1(void (*entry)(void))
+{
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, core1_thread, (void*)entry)) {
+    fprintf(stderr, "Couldn't start core 1\n");
+    abort();
+  }
+}
+
+void multicore_fifo_push_blocking(uint32_t data)
+{
+  Fifo* f = &fifo[!core_num];
+  pthread_mutex_lock(&fifo_lock);
+  while (f->count == FIFO_DEPTH) pthread_cond_wait(&fifo_cond, &fifo_lock);
+  f->data[(f->head + f->count++) % FIFO_DEPTH] = data;
+  if (core_num == 1) host_board_stats.core1_busy_us += time_us_64() - core1_start_us;
+  pthread_cond_broadcast(&fifo_cond);
+  pthread_mutex_unlock(&fifo_lock);
+}
+
+uint32_t multicore_fifo_pop_blocking(void)
+{
+  Fifo* f = &fifo[core_num];
+  uint64_t start = time_us_64();
+  pthread_mutex_lock(&fifo_lock);
+  while (f->count == 0) pthread_cond_wait(&fifo_cond, &fifo_lock);
+  uint32_t data = f->data[f->head];
+  f->head = (f->head + 1) % FIFO_DEPTH;
+  f->count--;
+  if (core_num == 1) {
+    core1_start_us = time_us_64();
+    host_board_stats.generations++;
+  } else {
+    host_board_stats.core0_wait_us += time_us_64() - start;
+  }
+  pthread_cond_broadcast(&fifo_cond);
+  pthread_mutex_unlock(&fifo_lock);
+  return data;
+}
+
+bool multicore_fifo_rvalid(void)
+{
+  pthread_mutex_lock(&fifo_lock);
+  bool valid = fifo[core_num].count > 0;
+  pthread_mutex_unlock(&fifo_lock);
+  return valid;
+}
+
+bool uart_is_writable(uart_inst_t* uart)
+{
+  (void)uart;
+  return true;
+}
+
+void uart_putc_raw(uart_inst_t* uart, char c)
+{
+  (void)uart;
+  if (host_board.uart) fputc(c, host_board.uart);
+}
+
+// The input trace given to replay, which ends the render once it runs out
+// or goes off the recorded path
+uint32_t input_board_replay(const uint8_t** replay)
+{
+  *replay = host_board.replay;
+  return host_board.replay_size;
+}
+
+void input_board_replay_ended(const InputTrace* t)
+{
+  fflush(video);
+  exit(t->mismatches || host_board_stats.byte_order_errors ? EXIT_FAILURE : 0);
+}
+
+// Nunchuck, for main.c built with USE_NUNCHUCK.  The stick is pushed part
+// way right, up, left and down in turn, each for 150 frames with 60
+// released between, and the buttons are never pressed.
+#define NUNCHUCK_HOLD_FRAMES 150
+#define NUNCHUCK_CYCLE_FRAMES 210
+#define NUNCHUCK_PUSH 60
+
+bool nunchuck_init(uint i2c_sda_pin, uint i2c_scl_pin)
+{
+  (void)i2c_sda_pin;
+  (void)i2c_scl_pin;
+  return true;
+}
+
+static int nunchuck_stick(int axis)
+{
+  uint32_t frame = host_board_stats.frames;
+  if (frame % NUNCHUCK_CYCLE_FRAMES >= NUNCHUCK_HOLD_FRAMES) return 0;
+  int direction = frame / NUNCHUCK_CYCLE_FRAMES % 4;
+  if (direction % 2 != axis) return 0;
+  return direction < 2 ? NUNCHUCK_PUSH : -NUNCHUCK_PUSH;
+}
+
+int nunchuck_joyx()
+{
+  return nunchuck_stick(0);
+}
+
+int nunchuck_joyy()
+{
+  return nunchuck_stick(1);
+}
+
+bool nunchuck_zbutton()
+{
+  return false;
+}
+
+bool nunchuck_cbutton()
+{
+  return false;
+}
+
+// Display
+static void write_frame()
+{
+  if (host_board.format == HOST_VIDEO_Y4M) {
+    if (host_board_stats.frames == 0) {
+      fprintf(video, "YUV4MPEG2 W%d H%d F%u:1 Ip A1:1 C444\n", SCREEN_WIDTH, SCREEN_HEIGHT, host_board.fps);
+    }
+    static uint8_t planes[3][SCREEN_WIDTH * SCREEN_HEIGHT];
+    for (int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; ++i) {
+      int r = (frame[i] >> 8) & 0xf8, g = (frame[i] >> 3) & 0xfc, b = (frame[i] << 3) & 0xf8;
+      r |= r >> 5;
+      g |= g >> 6;
+      b |= b >> 5;
+      // BT.601 studio range
+      planes[0][i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+      planes[1][i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+      planes[2][i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+    fprintf(video, "FRAME\n");
+    fwrite(planes, 1, sizeof(planes), video);
+  } else if (host_board.format == HOST_VIDEO_PPM) {
+    static uint8_t rgb[SCREEN_WIDTH * SCREEN_HEIGHT * 3];
+    for (int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; ++i) {
+      int r = (frame[i] >> 8) & 0xf8, g = (frame[i] >> 3) & 0xfc, b = (frame[i] << 3) & 0xf8;
+      rgb[3 * i] = r | (r >> 5);
+      rgb[3 * i + 1] = g | (g >> 6);
+      rgb[3 * i + 2] = b | (b >> 5);
+    }
+    fprintf(video, "P6\n%d %d\n255\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+    fwrite(rgb, 1, sizeof(rgb), video);
+  }
+
+  if (++host_board_stats.frames == host_board.frame_limit) {
+    fflush(video);
+    exit(host_board_stats.byte_order_errors ? EXIT_FAILURE : 0);
+  }
+}
+
+// The DMA and PIO as st7789_lcd.c sets them up.  Each DMA transfer reads
+// ST7789_PIXELS_PER_WORD pixels, swapping the bytes if ST7789_DMA_BSWAP,
+// and a 16-bit write to the FIFO is replicated across the word as on the
+// RP2040.  The PIO shifts ST7789_PULL_BITS of each word out MSB first, and
+// the ST7789 takes the high byte of each pixel first.  A pixel that arrives
+// different from the colour stored is counted as a byte order error.
+static void bus_transfer(const uint8_t* p)
+{
+  uint32_t word;
+  if (ST7789_PIXELS_PER_WORD == 2) {
+    word = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    if (ST7789_DMA_BSWAP) word = __builtin_bswap32(word);
+  } else {
+    uint16_t half = p[0] | (p[1] << 8);
+    if (ST7789_DMA_BSWAP) half = __builtin_bswap16(half);
+    word = half | ((uint32_t)half << 16);
+  }
+  host_board_stats.dma_transfers++;
+
+  for (int k = 0; k < ST7789_PULL_BITS / 16; ++k) {
+    uint16_t pixel = (word << (16 * k)) >> 16;
+    uint16_t stored = p[2 * k] | (p[2 * k + 1] << 8);
+    if (pixel != st7789_pixel(stored)) host_board_stats.byte_order_errors++;
+    if (frame_pos < SCREEN_PIXELS) frame[frame_pos] = pixel;
+    frame_pos++;
+  }
+}
+
+// Pixels are taken when the transfer is started, and the channel is busy
+// for as long as the serial link would take over them after the other
+// channel.
+static void dma_to_display(uint chan_idx, const void* pixels, bool incr, uint num_pixels)
+{
+  if (num_pixels % ST7789_PIXELS_PER_WORD || (uintptr_t)pixels % (2 * ST7789_PIXELS_PER_WORD)) {
+    fprintf(stderr, "Display DMA of %u pixels from %p isn't in whole aligned words\n", num_pixels, pixels);
+    abort();
+  }
+
+  if (host_board.spi_bit_rate) {
+    uint64_t us = (uint64_t)num_pixels * 16 * 1000000 / host_board.spi_bit_rate;
+    uint64_t start = MAX(time_us_64(), host_dma_busy_until[chan_idx ^ 1]);
+    host_dma_busy_until[chan_idx] = start + us;
+    host_board_stats.display_busy_us += us;
+  }
+
+  const uint8_t* p = pixels;
+  for (uint n = 0; n < num_pixels / ST7789_PIXELS_PER_WORD; ++n) {
+    bus_transfer(incr ? p + 2 * ST7789_PIXELS_PER_WORD * n : p);
+  }
+  if (frame_pos >= SCREEN_PIXELS) {
+    write_frame();
+    frame_pos = 0;
+  }
+}
+
+// The display backend, on DMA channels 0 and 1
+static void display_start_pixels(DisplayBackend* d)
+{
+  (void)d;
+  for (uint chan = 0; chan < 2; ++chan) dma_channel_wait_for_finish_blocking(chan);
+  frame_pos = 0;
+}
+
+static void display_stop_pixels(DisplayBackend* d)
+{
+  (void)d;
+}
+
+static void display_send_pixels(DisplayBackend* d, uint chan_idx, const uint16_t* pixels, uint num_pixels)
+{
+  (void)d;
+  dma_channel_wait_for_finish_blocking(chan_idx);
+  dma_to_display(chan_idx, pixels, true, num_pixels);
+}
+
+static void display_repeat_pixel(DisplayBackend* d, uint chan_idx, uint16_t pixel, uint repeats)
+{
+  (void)d;
+  dma_channel_wait_for_finish_blocking(chan_idx);
+  // As st7789_lcd.c sets up the word it repeats
+  static uint32_t pixel_to_dma[2];
+  pixel_to_dma[chan_idx] = pixel | ((uint32_t)pixel << 16);
+  dma_to_display(chan_idx, &pixel_to_dma[chan_idx], false, repeats);
+}
+
+static bool display_is_busy(DisplayBackend* d, uint chan_idx)
+{
+  (void)d;
+  return dma_channel_is_busy(chan_idx);
+}
+
+static void display_wait_for_finish(DisplayBackend* d, uint chan_idx)
+{
+  (void)d;
+  dma_channel_wait_for_finish_blocking(chan_idx);
+}
+
+// The model's display in place of the ST7789, on DMA channels 0 and 1
+void st7789_display_init(DisplayBackend* d, St7789Display* lcd, PIO pio, uint sm)
+{
+  lcd->pio = pio;
+  lcd->sm = sm;
+  lcd->chan[0] = 0;
+  lcd->chan[1] = 1;
+  d->start_pixels = display_start_pixels;
+  d->stop_pixels = display_stop_pixels;
+  d->send_pixels = display_send_pixels;
+  d->repeat_pixel = display_repeat_pixel;
+  d->is_busy = display_is_busy;
+  d->wait_for_finish = display_wait_for_finish;
+  d->state = lcd;
+}
@@ -0,0 +1,40 @@
+// Model of the board that main.c drives, so that it can run on the host:
+// core 1 is a thread, st7789_display_init sets up a DisplayBackend that
+// keeps a 240x240 framebuffer written out to a video stream, with each row
+// taking as long as the serial link to the ST7789 would, the UART goes to a
+// file, and the Nunchuck pans in a fixed pattern.  Given a trace, the
+// inputs are replayed from it instead, until it ends.
+
+#include <stdio.h>
+
+typedef enum {
+  HOST_VIDEO_Y4M,  // 4:4:4 YUV, which ffmpeg and most players read
+  HOST_VIDEO_PPM,  // Concatenated binary PPM images
+  HOST_VIDEO_NONE, // Frames are only counted
+} host_video_format_t;
+
+typedef struct {
+  host_video_format_t format;
+  uint32_t fps;          // Frame rate written in the Y4M header
+  uint32_t frame_limit;  // Exit once this many frames are written, 0 for never
+  uint32_t spi_bit_rate; // Display link bits per second, 0 for no limit
+  FILE* uart;            // Gets the bytes sent to uart0, or NULL
+  const uint8_t* replay; // Input trace to replay, or NULL
+  uint32_t replay_size;
+} HostBoardConfig;
+
+typedef struct {
+  uint64_t start_us;       // When main.c called stdio_init_all
+  uint32_t frames;
+  uint32_t generations;    // Buffers core 1 was given
+  uint64_t core1_busy_us;  // From core 1 taking a buffer to handing it back
+  uint64_t core0_wait_us;  // Core 0 blocked on the FIFO waiting for core 1
+  uint64_t dma_transfers;  // Display DMA reads, each a write to the PIO FIFO
+  uint64_t display_busy_us;  // Time the link was sending pixels
+  uint32_t byte_order_errors;  // Pixels displayed differently from stored
+} HostBoardStats;
+
+// Set before main.c starts.  stdio_init_all moves stdout to the video
+// stream and sends printf output to stderr instead.
+extern HostBoardConfig host_board;
+extern HostBoardStats host_board_stats;
@@ -0,0 +1,30 @@
+// Storage for the host stand-ins of Pico hardware blocks.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hardware/dma.h"
+#include "hardware/interp.h"
+#include "hardware/sync.h"
+
+_Thread_local interp_hw_t host_interp0_hw;
+
+volatile uint64_t host_dma_busy_until[NUM_DMA_CHANNELS];
+
+spin_lock_t host_spin_locks[NUM_SPIN_LOCKS];
+static uint32_t spin_locks_claimed;
+
+int spin_lock_claim_unused(bool required)
+{
+  for (int i = NUM_SPIN_LOCKS - 1; i >= 0; --i) {
+    if (!(spin_locks_claimed & (1u << i))) {
+      spin_locks_claimed |= 1u << i;
+      return i;
+    }
+  }
+  if (required) {
+    fprintf(stderr, "No spin locks are available\n");
+    abort();
+  }
+  return -1;
+}
@@ -0,0 +1,25 @@
+// Minimal stand-in for the Pico SDK's hardware/clocks.h.
+// The host runs at its own speed, so clock settings are ignored.
+
+#ifndef _HOST_HARDWARE_CLOCKS_H
+#define _HOST_HARDWARE_CLOCKS_H
+
+#include "pico/stdlib.h"
+
+#define MHZ 1000000
+
+enum clock_index { clk_gpout0, clk_gpout1, clk_gpout2, clk_gpout3, clk_ref, clk_sys, clk_peri };
+
+#define CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLK_SYS 0
+
+static inline void set_sys_clock_pll(uint32_t vco_freq, uint post_div1, uint post_div2) {
+  (void)vco_freq; (void)post_div1; (void)post_div2;
+}
+
+static inline bool clock_configure(enum clock_index clk_index, uint32_t src, uint32_t auxsrc,
+                                   uint32_t src_freq, uint32_t freq) {
+  (void)clk_index; (void)src; (void)auxsrc; (void)src_freq; (void)freq;
+  return true;
+}
+
+#endif
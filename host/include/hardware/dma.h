@@ -0,0 +1,23 @@
+// Minimal stand-in for the Pico SDK's hardware/dma.h.
+// Channels are busy until the time in host_dma_busy_until, which only the
+// display in host_board.c sets, so for the library alone they never are.
+
+#ifndef _HOST_HARDWARE_DMA_H
+#define _HOST_HARDWARE_DMA_H
+
+#include "pico/stdlib.h"
+
+#define NUM_DMA_CHANNELS 12
+
+extern volatile uint64_t host_dma_busy_until[NUM_DMA_CHANNELS];  // time_us_64
+
+static inline bool dma_channel_is_busy(uint channel) {
+  return host_dma_busy_until[channel] > time_us_64();
+}
+
+static inline void dma_channel_wait_for_finish_blocking(uint channel) {
+  while (dma_channel_is_busy(channel))
+    ;
+}
+
+#endif
@@ -0,0 +1,96 @@
+// Minimal stand-in for the Pico SDK's hardware/interp.h.
+// The registers are plain memory, and the result accessors compute lanes
+// 0 and 1 (shift, mask, sign extension, base and ADD_RAW) and the full
+// result, which adds base 2 to both lanes.  Popping writes the lane
+// results back to the accumulators.  Blend, clamp and the cross options
+// aren't modelled.  Base 2 is pointer sized, so the full result can
+// address a host buffer as it does on the Pico.  Each thread has its own
+// interpolator, as each core does on the Pico.
+
+#ifndef _HOST_HARDWARE_INTERP_H
+#define _HOST_HARDWARE_INTERP_H
+
+#include "pico/stdlib.h"
+
+typedef struct {
+  uint32_t accum[2];
+  uintptr_t base[3];
+  uint32_t ctrl[2];
+} interp_hw_t;
+
+typedef struct {
+  uint32_t ctrl;
+} interp_config;
+
+extern _Thread_local interp_hw_t host_interp0_hw;
+#define interp0 (&host_interp0_hw)
+
+static inline interp_config interp_default_config() {
+  interp_config c = { 0 };
+  return c;
+}
+
+static inline void interp_config_set_shift(interp_config* c, uint shift) {
+  c->ctrl = (c->ctrl & ~0x1fu) | (shift & 0x1f);
+}
+
+static inline void interp_config_set_mask(interp_config* c, uint mask_lsb, uint mask_msb) {
+  c->ctrl = (c->ctrl & ~0x7fe0u) | ((mask_lsb & 0x1f) << 5) | ((mask_msb & 0x1f) << 10);
+}
+
+static inline void interp_config_set_signed(interp_config* c, bool _signed) {
+  c->ctrl = (c->ctrl & ~(1u << 15)) | (_signed ? 1u << 15 : 0);
+}
+
+static inline void interp_config_set_add_raw(interp_config* c, bool add_raw) {
+  c->ctrl = (c->ctrl & ~(1u << 18)) | (add_raw ? 1u << 18 : 0);
+}
+
+static inline void interp_config_set_blend(interp_config* c, bool blend) {
+  c->ctrl = (c->ctrl & ~(1u << 21)) | (blend ? 1u << 21 : 0);
+}
+
+static inline void interp_set_config(interp_hw_t* interp, uint lane, interp_config* config) {
+  interp->ctrl[lane] = config->ctrl;
+}
+
+// The lane's accumulator shifted, masked and sign extended
+static inline uint32_t host_interp_shift_mask(const interp_hw_t* interp, uint lane) {
+  uint32_t ctrl = interp->ctrl[lane];
+  uint mask_lsb = (ctrl >> 5) & 0x1f;
+  uint mask_msb = (ctrl >> 10) & 0x1f;
+  uint32_t mask = (0xffffffffu >> (31 - mask_msb)) & ~((1u << mask_lsb) - 1);
+  uint32_t value = (interp->accum[lane] >> (ctrl & 0x1f)) & mask;
+  if ((ctrl & (1u << 15)) && (value & (1u << mask_msb))) value |= ~((2u << mask_msb) - 1);
+  return value;
+}
+
+static inline uint32_t interp_peek_lane_result(interp_hw_t* interp, uint lane) {
+  uint32_t value = interp->ctrl[lane] & (1u << 18) ? interp->accum[lane] : host_interp_shift_mask(interp, lane);
+  return (uint32_t)interp->base[lane] + value;
+}
+
+static inline uintptr_t interp_peek_full_result(interp_hw_t* interp) {
+  return interp->base[2] + (intptr_t)(int32_t)host_interp_shift_mask(interp, 0) +
+         (intptr_t)(int32_t)host_interp_shift_mask(interp, 1);
+}
+
+static inline void host_interp_update(interp_hw_t* interp) {
+  uint32_t result0 = interp_peek_lane_result(interp, 0);
+  interp->accum[1] = interp_peek_lane_result(interp, 1);
+  interp->accum[0] = result0;
+}
+
+static inline uint32_t interp_pop_lane_result(interp_hw_t* interp, uint lane) {
+  uint32_t result = interp_peek_lane_result(interp, lane);
+  host_interp_update(interp);
+  return result;
+}
+
+static inline uintptr_t interp_pop_full_result(interp_hw_t* interp) {
+  uintptr_t result = interp_peek_full_result(interp);
+  host_interp_update(interp);
+  return result;
+}
+
+#endif
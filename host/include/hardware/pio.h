@@ -0,0 +1,14 @@
+// Minimal stand-in for the Pico SDK's hardware/pio.h.
+// main.c only passes the PIO on to the display, which host_board.c models.
+
+#ifndef _HOST_HARDWARE_PIO_H
+#define _HOST_HARDWARE_PIO_H
+
+#include "pico/stdlib.h"
+
+typedef struct pio_hw pio_hw_t;
+typedef pio_hw_t* PIO;
+
+#define pio0 ((PIO)NULL)
+
+#endif
@@ -0,0 +1,2 @@
+// Stand-in for the Pico SDK's hardware/regs/addressmap.h.  main.c only
+// uses peripheral addresses on the device.
@@ -0,0 +1,2 @@
+// Stand-in for the Pico SDK's hardware/regs/rosc.h.  There is no ring
+// oscillator on the host, and main.c only reads it on the device.
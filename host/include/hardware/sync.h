@@ -0,0 +1,49 @@
+// Minimal stand-in for the Pico SDK's hardware/sync.h.
+// Spin locks are C11 atomic flags, so they also work between host threads.
+// Events aren't modelled: waiting for one yields to the other threads, as
+// the Pico's wfe may return before an event too.
+
+#ifndef _HOST_HARDWARE_SYNC_H
+#define _HOST_HARDWARE_SYNC_H
+
+#include <stdatomic.h>
+#include <sched.h>
+#include "pico/stdlib.h"
+
+#define NUM_SPIN_LOCKS 32
+
+typedef atomic_flag spin_lock_t;
+
+extern spin_lock_t host_spin_locks[NUM_SPIN_LOCKS];
+
+int spin_lock_claim_unused(bool required);
+
+static inline spin_lock_t* spin_lock_instance(uint lock_num) {
+  return &host_spin_locks[lock_num];
+}
+
+static inline spin_lock_t* spin_lock_init(uint lock_num) {
+  spin_lock_t* lock = spin_lock_instance(lock_num);
+  atomic_flag_clear(lock);
+  return lock;
+}
+
+static inline uint32_t spin_lock_blocking(spin_lock_t* lock) {
+  while (atomic_flag_test_and_set_explicit(lock, memory_order_acquire))
+    ;
+  return 0;
+}
+
+static inline void spin_unlock(spin_lock_t* lock, uint32_t saved_irq) {
+  (void)saved_irq;
+  atomic_flag_clear_explicit(lock, memory_order_release);
+}
+
+static inline void __wfe(void) {
+  sched_yield();
+}
+
+static inline void __sev(void) {
+}
+
+#endif
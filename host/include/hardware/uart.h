@@ -0,0 +1,16 @@
+// Minimal stand-in for the Pico SDK's hardware/uart.h.
+// host_board.c writes what is sent to uart0 to a file, if it has one.
+
+#ifndef _HOST_HARDWARE_UART_H
+#define _HOST_HARDWARE_UART_H
+
+#include "pico/stdlib.h"
+
+typedef struct uart_inst uart_inst_t;
+
+#define uart0 ((uart_inst_t*)NULL)
+
+bool uart_is_writable(uart_inst_t* uart);
+void uart_putc_raw(uart_inst_t* uart, char c);
+
+#endif
@@ -0,0 +1,15 @@
+// Minimal stand-in for the Pico SDK's pico/multicore.h, for running main.c
+// on the board model in host_board.c.  Core 1 is a thread, and each
+// direction of the inter-core FIFO is a queue of 8 words as on the RP2040.
+
+#ifndef _HOST_PICO_MULTICORE_H
+#define _HOST_PICO_MULTICORE_H
+
+#include "pico/stdlib.h"
+
+void multicore_launch_core1(void (*entry)(void));
+void multicore_fifo_push_blocking(uint32_t data);
+uint32_t multicore_fifo_pop_blocking(void);
+bool multicore_fifo_rvalid(void);
+
+#endif
@@ -0,0 +1,61 @@
+// Minimal stand-in for the Pico SDK's pico/stdlib.h so that the generation
+// code can be built and benchmarked on a Linux host.
+
+#ifndef _HOST_PICO_STDLIB_H
+#define _HOST_PICO_STDLIB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+typedef unsigned int uint;
+
+#define PICO_ON_DEVICE 0
+
+#ifndef MIN
+#define MIN(a, b) ((b) > (a) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+typedef uint64_t absolute_time_t;
+
+static inline uint64_t time_us_64(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000u + ts.tv_nsec / 1000;
+}
+
+static inline uint32_t time_us_32(void)
+{
+  return (uint32_t)time_us_64();
+}
+
+static inline absolute_time_t get_absolute_time(void)
+{
+  return time_us_64();
+}
+
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to)
+{
+  return (int64_t)(to - from);
+}
+
+static inline void sleep_us(uint64_t us)
+{
+  struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+  nanosleep(&ts, NULL);
+}
+
+static inline void sleep_ms(uint32_t ms)
+{
+  sleep_us(ms * 1000ull);
+}
+
+// Only in programs built with host_board.c
+void stdio_init_all(void);
+
+#endif
@@ -0,0 +1,2 @@
+// Stand-in for the header generated from st7789_lcd.pio.  The display is
+// modelled by host_board.c, so nothing from the PIO program is needed.
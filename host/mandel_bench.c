@@ -0,0 +1,172 @@
+// Host benchmark for the fractal generation kernels.
+//
+// Generates a fixed set of viewports with each cycle check and max_iter
+// setting and reports throughput.  Iterations are counted from the
+// resulting buffer as escape-time iterations, i.e. the work a kernel
+// without any early exit would do, so early-exit kernels show up as a
+// lower ns/iter.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pico/stdlib.h"
+
+#include "mandelbrot.h"
+#include "mandel_threads.h"
+#include "mandel_simd.h"
+
+#define IMAGE_ROWS 340
+#define IMAGE_COLS 340
+
+typedef struct {
+  const char* name;
+  double centrex, centrey;
+  double sizex, sizey;
+  bool use_perturbation;
+} Viewport;
+
+static const Viewport viewports[] = {
+  { "full",     -1.0,     0.0,     3.5,    3.2,    false },
+  { "interior", -0.2,     0.0,     0.5,    0.5,    false },
+  { "seahorse", -0.75,    0.1,     0.2,    0.2,    false },
+  { "spiral",   -1.01,    -0.3125, 0.01,   0.01,   false },
+  { "deep",     -1.0023,  -0.3043, 0.0005, 0.0005, false },
+  { "deep-q60", 0.0,      1.0,     1e-9,   1e-9,   false },
+  { "deep-pt",  -1.0023,  -0.3043, 0.0005, 0.0005, true },
+  { "pt-1e-9",  0.0,      1.0,     1e-9,   1e-9,   true },
+  { "pt-1e-12", 0.0,      1.0,     1e-12,  1e-12,  true },
+};
+
+static const uint16_t max_iters[] = { 0x40, 0x80, 0xe0 };
+
+typedef enum {
+  MODE_GENERATE,
+  MODE_STEAL,
+  MODE_THREADS,
+  MODE_SIMD,
+  MODE_SMOOTH,
+} BenchMode;
+
+static const char* mode_names[] = { "generate", "steal", "threads", "simd", "smooth" };
+static const char* precision_names[] = { "auto", "q6.26", "q4.28", "q4.60" };
+static const char* fractal_mode_names[] = { "raster", "ms", "prog" };
+
+static uint8_t iter_buff[IMAGE_ROWS * IMAGE_COLS];
+static uint8_t smooth_buff[IMAGE_ROWS * IMAGE_COLS];
+static pert_float_t ref_orbit[2 * 0x100];
+static int num_threads = 1;
+
+static double now_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t count_iterations(const FractalBuffer* f)
+{
+  uint64_t iters = 0;
+  for (int16_t i = 0; i < f->rows; ++i) {
+    for (int16_t j = 0; j < f->cols; ++j) {
+      uint16_t k = fractal_pixel(f, i, j);
+      if (k == 0) iters += f->max_iter - 1;
+      else iters += k + f->iter_offset;
+    }
+  }
+  return iters;
+}
+
+static void setup_fractal(FractalBuffer* f, const Viewport* v, fractal_mode_t fractal_mode,
+                          uint16_t max_iter, bool use_cycle_check)
+{
+  memset(f, 0, sizeof(*f));
+  f->buff = iter_buff;
+  f->rows = IMAGE_ROWS;
+  f->cols = IMAGE_COLS;
+  f->mode = fractal_mode;
+  f->max_iter = max_iter;
+  f->iter_offset = 0;
+  f->use_cycle_check = use_cycle_check;
+  f->use_perturbation = v->use_perturbation;
+  f->ref_orbit = ref_orbit;
+  f->minx = v->centrex - 0.5 * v->sizex;
+  f->maxx = v->centrex + 0.5 * v->sizex;
+  f->miny = v->centrey - 0.5 * v->sizey;
+  f->maxy = v->centrey + 0.5 * v->sizey;
+}
+
+static void run_once(FractalBuffer* f, BenchMode mode)
+{
+  init_fractal(f);
+  mandel_simd_enabled = (mode == MODE_SIMD);
+  if (mode == MODE_GENERATE || mode == MODE_SIMD || mode == MODE_SMOOTH) {
+    generate_fractal(f);
+  } else if (mode == MODE_STEAL) {
+    // With nothing running generate_fractal, stealing does the whole image
+    generate_steal_until_done(f);
+  } else {
+    generate_fractal_threads(f, num_threads);
+  }
+}
+
+static void bench_config(const Viewport* v, BenchMode mode, fractal_mode_t order,
+                         uint16_t max_iter, bool use_cycle_check, double min_time)
+{
+  FractalBuffer fractal;
+  setup_fractal(&fractal, v, order, max_iter, use_cycle_check);
+  if (mode == MODE_SMOOTH) fractal.smooth = smooth_buff;
+
+  // Warm up, and count the work done for this configuration
+  run_once(&fractal, mode);
+  uint64_t iters = count_iterations(&fractal);
+
+  int reps = 0;
+  double start = now_seconds();
+  double elapsed;
+  do {
+    run_once(&fractal, mode);
+    ++reps;
+    elapsed = now_seconds() - start;
+  } while (elapsed < min_time);
+
+  double pixels = (double)reps * fractal.rows * fractal.cols;
+  double total_iters = (double)reps * iters;
+  printf("%-9s %-8s %-6s %-6s %-5s %5d %12.3f %12.3f %10.3f\n",
+         v->name, mode_names[mode], fractal_mode_names[order],
+         fractal.use_perturbation ? "pert" : precision_names[fractal.active_precision],
+         use_cycle_check ? "on" : "off", max_iter,
+         pixels / elapsed * 1e-6, total_iters / elapsed * 1e-6,
+         elapsed * 1e9 / total_iters);
+}
+
+int main(int argc, char** argv)
+{
+  double min_time = 0.25;
+  const char* filter = NULL;
+  if (argc > 1) min_time = atof(argv[1]);
+  if (argc > 2) filter = argv[2];
+  if (argc > 3) num_threads = atoi(argv[3]);
+
+  mandel_init();
+  printf("SIMD kernel: %s\n", mandel_simd_name());
+
+  printf("%-9s %-8s %-6s %-6s %-5s %5s %12s %12s %10s\n",
+         "viewport", "mode", "order", "kernel", "cycle", "iter", "Mpixels/s", "Miter/s", "ns/iter");
+
+  for (size_t v = 0; v < sizeof(viewports) / sizeof(viewports[0]); ++v) {
+    if (filter && !strstr(viewports[v].name, filter)) continue;
+    for (int mode = MODE_GENERATE; mode <= MODE_SMOOTH; ++mode) {
+      if (mode == MODE_THREADS && num_threads <= 1) continue;
+      for (int order = FRACTAL_MODE_RASTER; order <= FRACTAL_MODE_PROGRESSIVE; ++order) {
+        for (int cycle = 0; cycle < 2; ++cycle) {
+          for (size_t m = 0; m < sizeof(max_iters) / sizeof(max_iters[0]); ++m) {
+            bench_config(&viewports[v], mode, order, max_iters[m], cycle, min_time);
+          }
+        }
+      }
+    }
+  }
+
+  return 0;
+}
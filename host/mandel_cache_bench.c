@@ -0,0 +1,128 @@
+// Host benchmark for the tile cache.
+//
+// Replays a pan and zoom path like one driven with the Nunchuck: zoom in
+// towards a point, pan away and back, zoom out and in again.  The path is
+// generated with each arena size, 0 being no cache, and the time, pixels
+// iterated, cache hit rate, bytes used and evictions are reported.
+//
+//   mandel_cache_bench [repeats]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pico/stdlib.h"
+
+#include "mandelbrot.h"
+#include "mandel_simd.h"
+
+#define IMAGE_ROWS 340
+#define IMAGE_COLS 340
+
+// Each step of the path moves the centre by (dx, dy) times the view size
+// and zooms by zoom
+typedef struct {
+  int steps;
+  double dx, dy;
+  double zoom;
+} PathSegment;
+
+static const PathSegment path[] = {
+  { 24, 0.0,   0.0,   0.85 },   // Zoom in
+  { 12, 0.08,  0.0,   1.0 },    // Pan right
+  { 12, -0.08, 0.0,   1.0 },    // and back
+  { 8,  0.0,   0.06,  1.0 },    // Pan down
+  { 8,  0.0,   -0.06, 1.0 },    // and back
+  { 12, 0.0,   0.0,   1.25 },   // Zoom out
+  { 12, 0.0,   0.0,   0.8 },    // and in again
+};
+
+static const uint16_t arena_sizes[] = { 0, 512, 2048, 8192 };
+
+static uint8_t iter_buff[IMAGE_ROWS * IMAGE_COLS];
+static FractalCacheTile tiles[8192];
+static uint16_t buckets[4096];
+
+static double now_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void run_path(uint16_t num_tiles, fractal_mode_t mode, int repeats)
+{
+  FractalCache cache;
+  fractal_cache_init(&cache, tiles, num_tiles, buckets, 4096);
+
+  double centrex = -0.743643887, centrey = 0.131825904;
+  double size = 3.2;
+  uint64_t lookups = 0, hits = 0, iterated = 0;
+  int generations = 0;
+  double start = now_seconds();
+  for (int r = 0; r < repeats; ++r) {
+    double x = -0.75, y = 0.0, s = size;
+    for (size_t p = 0; p < sizeof(path) / sizeof(path[0]); ++p) {
+      for (int step = 0; step < path[p].steps; ++step) {
+        if (path[p].zoom < 1.0) {
+          // Zooming in heads towards the target
+          x += (centrex - x) * (1.0 - path[p].zoom);
+          y += (centrey - y) * (1.0 - path[p].zoom);
+        }
+        x += path[p].dx * s;
+        y += path[p].dy * s;
+        s *= path[p].zoom;
+
+        FractalBuffer f;
+        memset(&f, 0, sizeof(f));
+        f.buff = iter_buff;
+        f.rows = IMAGE_ROWS;
+        f.cols = IMAGE_COLS;
+        f.max_iter = 0xe0;
+        f.mode = mode;
+        f.use_cycle_check = true;
+        f.cache = num_tiles ? &cache : NULL;
+        f.minx = x - 0.5 * s;
+        f.maxx = x + 0.5 * s;
+        f.miny = y - 0.5 * s;
+        f.maxy = y + 0.5 * s;
+        fractal_cache_snap_viewport(&f);
+        init_fractal(&f);
+        generate_fractal(&f);
+        fractal_cache_store(&f);
+
+        for (int w = 0; w < FRACTAL_MAX_WORKERS; ++w) iterated += f.workers[w].pixels;
+        iterated -= f.cache_hits;
+        lookups += f.cache_lookups;
+        hits += f.cache_hits;
+        ++generations;
+      }
+    }
+  }
+  double elapsed = now_seconds() - start;
+
+  printf("%-6s %6u %10.2f %12.0f %8.1f %10u %10u\n",
+         mode == FRACTAL_MODE_RASTER ? "raster" : "ms", num_tiles,
+         elapsed * 1e3 / generations, (double)iterated / generations,
+         lookups ? 100.0 * hits / lookups : 0.0,
+         fractal_cache_bytes_used(&cache), cache.evictions / repeats);
+}
+
+int main(int argc, char** argv)
+{
+  int repeats = 1;
+  if (argc > 1) repeats = atoi(argv[1]);
+
+  mandel_init();
+  // The cache turns the SIMD kernel off, so compare with the scalar one
+  mandel_simd_enabled = false;
+
+  printf("%-6s %6s %10s %12s %8s %10s %10s\n",
+         "order", "tiles", "ms/gen", "pixels/gen", "hit %", "bytes", "evictions");
+  for (int mode = FRACTAL_MODE_RASTER; mode <= FRACTAL_MODE_MARIANI_SILVER; ++mode) {
+    for (size_t a = 0; a < sizeof(arena_sizes) / sizeof(arena_sizes[0]); ++a) {
+      run_path(arena_sizes[a], mode, repeats);
+    }
+  }
+  return 0;
+}
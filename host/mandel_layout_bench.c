@@ -0,0 +1,229 @@
+// Host benchmark comparing the iteration buffer layouts.
+//
+// For a range of image sizes, generates the same view into a row major and
+// a tiled buffer and times generation and the kinds of scan done over the
+// buffer: the neighbourhood scan of choose_init_zoomc, a column order scan,
+// the Mariani-Silver style border check of square blocks, and the nearest
+// and bilinear display samplers.  Cache misses are counted with perf events where the kernel
+// allows it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "pico/stdlib.h"
+
+#include "mandelbrot.h"
+#include "scaler.h"
+
+static const int16_t image_sizes[] = { 340, 1024, 2048 };
+
+#define MAX_SIZE 2048
+#define BLOCK_SIZE 34
+
+static uint8_t iter_buff[FRACTAL_TILED_BUFFER_SIZE(MAX_SIZE, MAX_SIZE)];
+static const char* layout_names[] = { "row", "tiled" };
+
+static volatile uint32_t sink;
+static int perf_fd = -1;
+
+static double now_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void open_cache_miss_counter()
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = PERF_COUNT_HW_CACHE_MISSES;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  perf_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void start_cache_misses()
+{
+  if (perf_fd < 0) return;
+  ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+// Returns -1 if cache misses can't be counted
+static int64_t stop_cache_misses()
+{
+  if (perf_fd < 0) return -1;
+  ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+  int64_t count;
+  if (read(perf_fd, &count, sizeof(count)) != sizeof(count)) return -1;
+  return count;
+}
+
+static void setup_fractal(FractalBuffer* f, int16_t size, fractal_layout_t layout)
+{
+  memset(f, 0, sizeof(*f));
+  f->buff = iter_buff;
+  f->rows = size;
+  f->cols = size;
+  f->mode = FRACTAL_MODE_MARIANI_SILVER;
+  f->layout = layout;
+  f->max_iter = 0x40;
+  f->minx = -0.85;
+  f->maxx = -0.65;
+  f->miny = 0.0;
+  f->maxy = 0.2;
+}
+
+static void run_generate(FractalBuffer* f)
+{
+  init_fractal(f);
+  generate_fractal(f);
+}
+
+static void run_neighbours(FractalBuffer* f)
+{
+  uint32_t count = 0;
+  for (int16_t i = 1; i < f->rows - 1; ++i) {
+    for (int16_t j = 1; j < f->cols - 1; ++j) {
+      if (fractal_pixel(f, i, j) == 0) continue;
+      int n = (fractal_pixel(f, i - 1, j) == 0) + (fractal_pixel(f, i + 1, j) == 0) +
+              (fractal_pixel(f, i, j - 1) == 0) + (fractal_pixel(f, i, j + 1) == 0);
+      if (n == 1) ++count;
+    }
+  }
+  sink = count;
+}
+
+static void run_columns(FractalBuffer* f)
+{
+  uint32_t sum = 0;
+  for (int16_t j = 0; j < f->cols; ++j) {
+    for (int16_t i = 0; i < f->rows; ++i) {
+      sum += fractal_pixel(f, i, j);
+    }
+  }
+  sink = sum;
+}
+
+static void run_blocks(FractalBuffer* f)
+{
+  uint32_t uniform = 0;
+  for (int16_t i0 = 0; i0 + BLOCK_SIZE <= f->rows; i0 += BLOCK_SIZE - 1) {
+    for (int16_t j0 = 0; j0 + BLOCK_SIZE <= f->cols; j0 += BLOCK_SIZE - 1) {
+      int16_t i1 = i0 + BLOCK_SIZE - 1;
+      int16_t j1 = j0 + BLOCK_SIZE - 1;
+      uint8_t v = fractal_pixel(f, i0, j0);
+      bool same = true;
+      for (int16_t j = j0; j <= j1 && same; ++j) {
+        same = fractal_pixel(f, i0, j) == v && fractal_pixel(f, i1, j) == v;
+      }
+      for (int16_t i = i0 + 1; i < i1 && same; ++i) {
+        same = fractal_pixel(f, i, j0) == v && fractal_pixel(f, i, j1) == v;
+      }
+      uniform += same;
+    }
+  }
+  sink = uniform;
+}
+
+// Sample a 240x240 display from the middle two thirds of the image, as
+// main() does while zooming
+static void run_display(FractalBuffer* f)
+{
+  const int display = 240;
+  uint32_t sum = 0;
+  int32_t step = (int32_t)((2.0 / 3.0) * f->cols * (1 << 16) / display);
+  int32_t start = f->cols * (1 << 16) / 6;
+  for (int i = 0, y = start; i < display; ++i, y += step) {
+    for (int j = 0, x = start; j < display; ++j, x += step) {
+      sum += fractal_pixel(f, y >> 16, x >> 16);
+    }
+  }
+  sink = sum;
+}
+
+// The same with bilinear scaling, at a quarter of the zoom so the display
+// is upscaled from the buffer
+static void run_bilinear(FractalBuffer* f)
+{
+  static uint16_t palette[256 << 2];
+  const int display = 240;
+  uint16_t row[240];
+  uint32_t sum = 0;
+  int32_t step = (int32_t)((1.0 / 4.0) * f->cols * (1 << SCALE_FIXED_PT) / display);
+  int32_t start = (int32_t)((3.0 / 8.0) * f->cols * (1 << SCALE_FIXED_PT));
+  for (int i = 0, y = start; i < display; ++i, y += step) {
+    scale_row_bilinear(f, palette, 2, y, start, step, display, row);
+    sum += row[i];
+  }
+  sink = sum;
+}
+
+typedef struct {
+  const char* name;
+  void (*run)(FractalBuffer* f);
+} Workload;
+
+static const Workload workloads[] = {
+  { "generate", run_generate },
+  { "neighbours", run_neighbours },
+  { "columns", run_columns },
+  { "blocks", run_blocks },
+  { "display", run_display },
+  { "bilinear", run_bilinear },
+};
+
+static void bench_workload(const Workload* w, int16_t size, fractal_layout_t layout, double min_time)
+{
+  FractalBuffer fractal;
+  setup_fractal(&fractal, size, layout);
+  run_generate(&fractal);
+  w->run(&fractal);
+
+  int reps = 0;
+  int64_t misses = 0;
+  double start = now_seconds();
+  double elapsed;
+  do {
+    start_cache_misses();
+    w->run(&fractal);
+    int64_t m = stop_cache_misses();
+    misses = (m < 0 || misses < 0) ? -1 : misses + m;
+    ++reps;
+    elapsed = now_seconds() - start;
+  } while (elapsed < min_time);
+
+  printf("%-10s %5d %-6s %12.3f", w->name, size, layout_names[layout], elapsed * 1e3 / reps);
+  if (misses >= 0) printf(" %14.0f\n", (double)misses / reps);
+  else printf(" %14s\n", "-");
+}
+
+int main(int argc, char** argv)
+{
+  double min_time = 0.25;
+  if (argc > 1) min_time = atof(argv[1]);
+
+  mandel_init();
+  open_cache_miss_counter();
+
+  printf("%-10s %5s %-6s %12s %14s\n", "workload", "size", "layout", "ms/run", "misses/run");
+
+  for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); ++w) {
+    for (size_t s = 0; s < sizeof(image_sizes) / sizeof(image_sizes[0]); ++s) {
+      for (int layout = FRACTAL_LAYOUT_ROW_MAJOR; layout <= FRACTAL_LAYOUT_TILED; ++layout) {
+        bench_workload(&workloads[w], image_sizes[s], layout, min_time);
+      }
+    }
+  }
+
+  return 0;
+}
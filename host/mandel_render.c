@@ -0,0 +1,115 @@
+// Headless render of the zoom from main.c, which runs unchanged on the
+// board model in host_board.c.  The display is written to stdout.
+//
+//   mandel_render [frames] [y4m|ppm|none] [display Mbit/s] [seed] [telemetry file] [replay file] > zoom.y4m
+//
+// The display link defaults to the bit rate the ST7789 gets at 133MHz, so
+// the generation and display pipeline behaves as it does on the Pico.
+// Other rates show how the work core 0 steals between rows changes with
+// display speed, and 0 displays as fast as the host can.  On exit, the
+// frame rate, the overlap of generation with display, the time the link
+// was busy, and the display DMA transfers go to stderr.  The exit status
+// is 1 if any pixel reached the display in the wrong byte order.
+//
+// The telemetry file also gets the input trace main.c records.  Given a
+// replay file, which is such a file or a capture of the Pico's UART, the
+// seed and inputs come from the trace in it instead, so the zoom follows
+// the recorded path, and the render stops at the end of the trace with
+// exit status 1 if any generation's viewport differed from the recording.
+// Frames 0 replays the whole trace.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "hardware/pio.h"
+
+#include "mandelbrot.h"
+#include "input.h"
+#include "display.h"
+#include "host_board.h"
+#include "st7789_lcd.h"
+
+// The PIO program takes 2 cycles per bit, at the 133MHz clock divided by
+// ST7789_SERIAL_CLK_DIV
+#define ST7789_BIT_RATE ((uint32_t)(133e6f / (2 * ST7789_SERIAL_CLK_DIV)))
+
+int mandel_main();
+extern InputTrace input_trace;  // In main.c
+
+static void report()
+{
+  const HostBoardStats* s = &host_board_stats;
+  double seconds = (time_us_64() - s->start_us) * 1e-6;
+  fprintf(stderr, "%u frames in %.2fs, %.1f frames/s\n", s->frames, seconds, s->frames / seconds);
+  if (s->frames) {
+    fprintf(stderr, "%.0f display DMA transfers per frame, %u pixels in the wrong byte order\n",
+            (double)s->dma_transfers / s->frames, s->byte_order_errors);
+  }
+  if (host_board.spi_bit_rate) {
+    fprintf(stderr, "Display link at %.2fMbit/s busy %.1f%% of the time\n",
+            host_board.spi_bit_rate * 1e-6, 100.0 * s->display_busy_us * 1e-6 / seconds);
+  }
+  if (host_board.replay) {
+    fprintf(stderr, "Replayed %u generations, %u off the recorded path, recorded over %.2fs\n",
+            input_trace.generations, input_trace.mismatches, input_trace.trace_us * 1e-6);
+  }
+  if (s->generations == 0 || s->core1_busy_us == 0) return;
+
+  // Core 0 displays frames until a buffer is done, then waits for core 1
+  double overlap = 1.0 - (double)s->core0_wait_us / s->core1_busy_us;
+  fprintf(stderr, "%u generations, %.1fms each, %.1f%% overlapped with display\n",
+          s->generations, s->core1_busy_us * 1e-3 / s->generations, 100.0 * MAX(0.0, overlap));
+}
+
+int main(int argc, char** argv)
+{
+  host_board.frame_limit = 300;
+  host_board.spi_bit_rate = ST7789_BIT_RATE;
+  unsigned seed = 1;
+  if (argc > 1) host_board.frame_limit = atoi(argv[1]);
+  if (argc > 2) {
+    if (!strcmp(argv[2], "ppm")) host_board.format = HOST_VIDEO_PPM;
+    else if (!strcmp(argv[2], "none")) host_board.format = HOST_VIDEO_NONE;
+    else host_board.format = HOST_VIDEO_Y4M;
+  }
+  if (argc > 3) host_board.spi_bit_rate = (uint32_t)(atof(argv[3]) * 1e6);
+  if (argc > 4) seed = atoi(argv[4]);
+  if (argc > 5) {
+    host_board.uart = fopen(argv[5], "wb");
+    if (!host_board.uart) {
+      perror(argv[5]);
+      return 1;
+    }
+  }
+  if (argc > 6) {
+    FILE* capture = fopen(argv[6], "rb");
+    if (!capture) {
+      perror(argv[6]);
+      return 1;
+    }
+    fseek(capture, 0, SEEK_END);
+    long len = ftell(capture);
+    rewind(capture);
+    uint8_t* data = malloc(len + 1);
+    len = fread(data, 1, len, capture);
+    fclose(capture);
+
+    // The trace is never longer than the frames carrying it
+    uint8_t* trace = malloc(len + 1);
+    host_board.replay_size = input_extract(data, len, trace, len);
+    host_board.replay = trace;
+    free(data);
+    if (host_board.replay_size == 0) {
+      fprintf(stderr, "No input trace in %s\n", argv[6]);
+      return 1;
+    }
+  }
+
+  // main.c seeds from the ring oscillator on the device, and records or
+  // replays the seed it uses
+  srand(seed);
+  atexit(report);
+  return mandel_main();
+}
@@ -0,0 +1,139 @@
+// Host benchmark for run-length encoded iteration buffers.
+//
+// Generates a zoom towards each target at 480x480, as main.c does with
+// RLE_BUFFER, into a row major buffer and into an encoded one with the
+// arena size main.c uses.  Reports the encoded size, the rows that had to
+// be stored at reduced resolution, the generation time of each, and the
+// time to decode every row and to decode the rows a 240 row display samples.
+//
+//   mandel_rle_bench [steps] [arena bytes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pico/stdlib.h"
+
+#include "mandelbrot.h"
+
+#define IMAGE_ROWS 480
+#define IMAGE_COLS 480
+#define DISPLAY_ROWS 240
+#define ARENA_SIZE (100 * 1024)
+
+typedef struct {
+  double x, y;
+} Target;
+
+static const Target targets[] = {
+  { -1.01, -0.3125 },
+  { -0.743643887, 0.131825904 },
+  { -0.1, 0.9 },
+};
+
+static uint8_t row_buff[IMAGE_ROWS * IMAGE_COLS];
+static uint8_t ring_buff[FRACTAL_RLE_RING_SIZE(IMAGE_COLS)];
+static uint8_t rle_data[IMAGE_ROWS * FRACTAL_RLE_ROW_BYTES(IMAGE_COLS)];
+static uint32_t rle_rows[IMAGE_ROWS];
+static uint8_t decoded[IMAGE_COLS];
+static volatile uint32_t sink;
+
+static double now_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void setup_fractal(FractalBuffer* f, double x, double y, double size)
+{
+  memset(f, 0, sizeof(*f));
+  f->rows = IMAGE_ROWS;
+  f->cols = IMAGE_COLS;
+  f->max_iter = 0xe0;
+  f->mode = FRACTAL_MODE_MARIANI_SILVER;
+  f->use_cycle_check = true;
+  f->minx = x - 0.5 * size;
+  f->maxx = x + 0.5 * size;
+  f->miny = y - 0.5 * size;
+  f->maxy = y + 0.5 * size;
+}
+
+static double time_generate(FractalBuffer* f)
+{
+  double start = now_seconds();
+  init_fractal(f);
+  generate_fractal(f);
+  return now_seconds() - start;
+}
+
+int main(int argc, char** argv)
+{
+  int steps = 48;
+  uint32_t arena_size = ARENA_SIZE;
+  if (argc > 1) steps = atoi(argv[1]);
+  if (argc > 2) arena_size = MIN(atoi(argv[2]), (int)sizeof(rle_data));
+
+  mandel_init();
+
+  printf("%-8s %10s %8s %8s %10s %10s %12s %12s\n", "target", "size", "bytes/px", "reduced",
+         "row ms", "rle ms", "decode ns/px", "display us");
+
+  for (size_t t = 0; t < sizeof(targets) / sizeof(targets[0]); ++t) {
+    double size = 3.2;
+    double total_bytes = 0, max_bytes = 0;
+    uint32_t total_reduced = 0;
+    for (int step = 0; step < steps; ++step, size *= 0.85) {
+      FractalBuffer row, rle;
+      setup_fractal(&row, targets[t].x, targets[t].y, size);
+      row.buff = row_buff;
+      double row_time = time_generate(&row);
+
+      setup_fractal(&rle, targets[t].x, targets[t].y, size);
+      rle.buff = ring_buff;
+      rle.layout = FRACTAL_LAYOUT_RLE;
+      rle.rle_data = rle_data;
+      rle.rle_size = arena_size;
+      rle.rle_rows = rle_rows;
+      double rle_time = time_generate(&rle);
+
+      // Decode the whole image enough times to measure
+      int reps = 0;
+      uint32_t sum = 0;
+      double start = now_seconds();
+      double decode_time;
+      do {
+        for (int16_t i = 0; i < IMAGE_ROWS; ++i) {
+          fractal_rle_row(&rle, i, decoded);
+          sum += decoded[i];
+        }
+        ++reps;
+        decode_time = now_seconds() - start;
+      } while (decode_time < 0.01);
+      decode_time /= reps;
+
+      // The display zoomed to two thirds of the buffer decodes each image
+      // row it samples once
+      start = now_seconds();
+      int16_t last = -1;
+      for (int i = 0; i < DISPLAY_ROWS; ++i) {
+        int16_t image_i = IMAGE_ROWS / 6 + i * (2 * IMAGE_ROWS / 3) / DISPLAY_ROWS;
+        if (image_i != last) fractal_rle_row(&rle, image_i, decoded);
+        last = image_i;
+        sum += decoded[i];
+      }
+      double display_time = now_seconds() - start;
+      sink = sum;
+
+      double bytes = (double)rle.rle_used / (IMAGE_ROWS * IMAGE_COLS);
+      total_bytes += bytes;
+      max_bytes = MAX(max_bytes, bytes);
+      total_reduced += rle.rle_reduced_rows;
+      printf("%-8zu %10.3g %8.3f %8u %10.2f %10.2f %12.2f %12.1f\n", t, size, bytes, rle.rle_reduced_rows,
+             row_time * 1e3, rle_time * 1e3, decode_time * 1e9 / (IMAGE_ROWS * IMAGE_COLS), display_time * 1e6);
+    }
+    printf("target %zu: mean %.3f bytes/px, max %.3f, %u rows reduced in %d steps\n\n",
+           t, total_bytes / steps, max_bytes, total_reduced, steps);
+  }
+  return 0;
+}
@@ -0,0 +1,160 @@
+// Vectorised escape time kernel, using GCC vector extensions so the same
+// code builds for SSE/AVX on x86-64 and NEON on aarch64.  On x86-64 the
+// kernel is cloned for AVX-512 and AVX2 and the best one for the CPU is
+// picked when the program is loaded.
+
+#include <string.h>
+
+#include "mandel_simd.h"
+
+bool mandel_simd_enabled = true;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SIMD_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define SIMD_CLONES
+#endif
+
+#define ESCAPE_SQUARE (4 << 26)
+
+// Coordinate for unused lanes, which escapes on the first iteration
+#define PAD_COORD (3 << 26)
+
+#if MANDEL_SIMD_DOUBLE
+
+#define LANES 8
+
+typedef double vf64 __attribute__((vector_size(LANES * 8)));
+typedef int64_t vi64 __attribute__((vector_size(LANES * 8)));
+
+static inline bool any_active(vi64 active)
+{
+  int64_t any = 0;
+  for (int l = 0; l < LANES; ++l) any |= active[l];
+  return any != 0;
+}
+
+SIMD_CLONES
+static void iterate_lanes(const int32_t* x0_in, const int32_t* y0_in, uint16_t max_iter, uint16_t* iters)
+{
+  vf64 x0, y0;
+  for (int l = 0; l < LANES; ++l) {
+    x0[l] = x0_in[l] * (1.0 / (1 << 26));
+    y0[l] = y0_in[l] * (1.0 / (1 << 26));
+  }
+
+  vf64 x = x0;
+  vf64 y = y0;
+  vi64 k = (vi64){} + 1;
+  vi64 active = (vi64){} - 1;
+  for (uint16_t n = 1; n < max_iter; ++n) {
+    vf64 x_square = x * x;
+    vf64 y_square = y * y;
+    active &= (x_square + y_square) <= 4.0;
+    k -= active;
+    if ((n & 3) == 0 && !any_active(active)) break;
+
+    vf64 nextx = x_square - y_square + x0;
+    y = 2.0 * x * y + y0;
+    x = nextx;
+  }
+
+  for (int l = 0; l < LANES; ++l) iters[l] = k[l];
+}
+
+#else
+
+#define LANES 16
+
+typedef int32_t vi32 __attribute__((vector_size(LANES * 4)));
+typedef uint32_t vu32 __attribute__((vector_size(LANES * 4)));
+
+// These match square and mul2 in mandelbrot.c.  Products and sums are done
+// unsigned so that they wrap as the scalar code does in practice.
+static inline vi32 vsquare(vi32 a)
+{
+  vi32 ah = a >> 13;
+  vi32 al = a & 0x1fff;
+  return (vi32)((vu32)((vi32)((vu32)ah * (vu32)al) >> 12) + (vu32)ah * (vu32)ah);
+}
+
+static inline vi32 vmul2(vi32 a, vi32 b)
+{
+  vi32 ah = a >> 12;
+  vi32 al = (a & 0xfff) << 1;
+  vi32 bh = b >> 13;
+  vi32 bl = b & 0x1fff;
+
+  vi32 r = (vi32)((vu32)ah * (vu32)bl + (vu32)al * (vu32)bh) >> 13;
+  return (vi32)((vu32)r + (vu32)ah * (vu32)bh);
+}
+
+static inline bool any_active(vi32 active)
+{
+  int32_t any = 0;
+  for (int l = 0; l < LANES; ++l) any |= active[l];
+  return any != 0;
+}
+
+SIMD_CLONES
+static void iterate_lanes(const int32_t* x0_in, const int32_t* y0_in, uint16_t max_iter, uint16_t* iters)
+{
+  vi32 x0, y0;
+  memcpy(&x0, x0_in, sizeof(x0));
+  memcpy(&y0, y0_in, sizeof(y0));
+
+  vi32 x = x0;
+  vi32 y = y0;
+  vi32 k = (vi32){} + 1;
+  vi32 active = (vi32){} - 1;
+  for (uint16_t n = 1; n < max_iter; ++n) {
+    vi32 x_square = vsquare(x);
+    vi32 y_square = vsquare(y);
+    active &= (vi32)((vu32)x_square + (vu32)y_square) <= ESCAPE_SQUARE;
+    k -= active;
+    if ((n & 3) == 0 && !any_active(active)) break;
+
+    vi32 nextx = (vi32)((vu32)x_square - (vu32)y_square + (vu32)x0);
+    y = (vi32)((vu32)vmul2(x, y) + (vu32)y0);
+    x = nextx;
+  }
+
+  for (int l = 0; l < LANES; ++l) iters[l] = k[l];
+}
+
+#endif
+
+const char* mandel_simd_name()
+{
+  const char* isa = "generic";
+#if defined(__x86_64__) && defined(__GNUC__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) isa = "avx512f";
+  else if (__builtin_cpu_supports("avx2")) isa = "avx2";
+#elif defined(__aarch64__)
+  isa = "neon";
+#endif
+  static char name[32];
+  strcpy(name, isa);
+  strcat(name, MANDEL_SIMD_DOUBLE ? " double" : " q6.26");
+  return name;
+}
+
+void mandel_simd_iterate(const int32_t* x0, const int32_t* y0, int count, uint16_t max_iter, uint16_t* iters)
+{
+  int n = 0;
+  for (; n + LANES <= count; n += LANES) {
+    iterate_lanes(x0 + n, y0 + n, max_iter, iters + n);
+  }
+
+  if (n < count) {
+    int32_t pad_x[LANES], pad_y[LANES];
+    uint16_t pad_iters[LANES];
+    for (int l = 0; l < LANES; ++l) {
+      pad_x[l] = (n + l < count) ? x0[n + l] : PAD_COORD;
+      pad_y[l] = (n + l < count) ? y0[n + l] : 0;
+    }
+    iterate_lanes(pad_x, pad_y, max_iter, pad_iters);
+    memcpy(iters + n, pad_iters, (count - n) * sizeof(uint16_t));
+  }
+}
@@ -0,0 +1,30 @@
+// Vectorised escape time kernel for host builds, iterating many pixels at
+// once.  The fixed point variant has exactly the semantics of the scalar
+// Q6.26 kernel, so gives bit identical output.  Building with
+// MANDEL_SIMD_DOUBLE instead iterates in double precision from the same
+// sample points, which is not bit identical.
+
+#ifndef _MANDEL_SIMD_H
+#define _MANDEL_SIMD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef MANDEL_SIMD_DOUBLE
+#define MANDEL_SIMD_DOUBLE 0
+#endif
+
+// Pixels passed to mandel_simd_iterate at once by the generation code
+#define MANDEL_SIMD_BATCH 64
+
+// Generation uses the SIMD kernel for eligible pixels while this is set
+extern bool mandel_simd_enabled;
+
+// Name of the variant in use, e.g. "avx2 q6.26"
+const char* mandel_simd_name();
+
+// Iterate count pixels with Q6.26 coordinates (x0[n], y0[n]), writing the
+// iteration each escaped at, or max_iter, to iters[n]
+void mandel_simd_iterate(const int32_t* x0, const int32_t* y0, int count, uint16_t max_iter, uint16_t* iters);
+
+#endif
@@ -0,0 +1,1087 @@
+// Host tests for the fractal generation code.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pico/stdlib.h"
+
+#include "mandelbrot.h"
+#include "mandel_threads.h"
+#include "mandel_simd.h"
+#include "scaler.h"
+#include "telemetry.h"
+#include "input.h"
+#include "hardware/interp.h"
+
+#define IMAGE_ROWS 340
+#define IMAGE_COLS 340
+
+static int failures;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+      printf(__VA_ARGS__); \
+      printf("\n"); \
+      ++failures; \
+    } \
+  } while (0)
+
+static uint8_t iter_buff[3][FRACTAL_TILED_BUFFER_SIZE(IMAGE_ROWS, IMAGE_COLS)];
+static uint16_t iter16_buff[2][IMAGE_ROWS * IMAGE_COLS];
+static uint8_t smooth_buff[2][IMAGE_ROWS * IMAGE_COLS];
+
+static void setup_fractal(FractalBuffer* f, uint8_t* buff, double centrex, double centrey, double size)
+{
+  memset(f, 0, sizeof(*f));
+  f->buff = buff;
+  f->rows = IMAGE_ROWS;
+  f->cols = IMAGE_COLS;
+  f->max_iter = 0xe0;
+  f->minx = centrex - 0.5 * size;
+  f->maxx = centrex + 0.5 * size;
+  f->miny = centrey - 0.5 * size;
+  f->maxy = centrey + 0.5 * size;
+}
+
+static void generate(FractalBuffer* f)
+{
+  init_fractal(f);
+  generate_fractal(f);
+  generate_steal_until_done(f);
+}
+
+// Samples copied from the previous generation must match a full recompute
+static void test_reuse(fractal_mode_t mode, int16_t ratio, double centrex, double centrey, double size)
+{
+  FractalBuffer prev, reused, full;
+
+  // Reused pixels are always iterated by the scalar kernel
+  mandel_simd_enabled = false;
+
+  setup_fractal(&prev, iter_buff[0], centrex, centrey, size);
+  snap_fractal_viewport(&prev, NULL, ratio);
+  generate(&prev);
+
+  setup_fractal(&reused, iter_buff[1], centrex + 0.01 * size, centrey - 0.02 * size, size / ratio);
+  reused.mode = mode;
+  snap_fractal_viewport(&reused, &prev, ratio);
+  reused.reuse_from = &prev;
+  generate(&reused);
+  CHECK(reused.reuse_ratio == ratio, "ratio %d, expected %d", reused.reuse_ratio, ratio);
+
+  // Mariani-Silver fills some of the coinciding samples instead
+  uint32_t expected_reuse = (IMAGE_ROWS / ratio) * (IMAGE_COLS / ratio);
+  if (mode == FRACTAL_MODE_MARIANI_SILVER) expected_reuse = 1;
+  CHECK(reused.reuse_count >= expected_reuse, "reused %u pixels, expected at least %u",
+        reused.reuse_count, expected_reuse);
+
+  full = reused;
+  full.buff = iter_buff[2];
+  full.reuse_from = NULL;
+  generate(&full);
+
+  int diffs = 0;
+  for (int i = 0; i < IMAGE_ROWS * IMAGE_COLS; ++i) {
+    if (reused.buff[i] != full.buff[i]) ++diffs;
+  }
+  CHECK(diffs == 0, "%d pixels differ from a full recompute", diffs);
+  CHECK(reused.count_inside == full.count_inside, "count_inside %u, expected %u",
+        reused.count_inside, full.count_inside);
+  CHECK(reused.min_iter == full.min_iter, "min_iter %u, expected %u", reused.min_iter, full.min_iter);
+  mandel_simd_enabled = true;
+}
+
+// Sharing the work between any number of workers must give the same
+// buffer and stats as a single worker
+static void test_workers(fractal_mode_t mode, bool use_perturbation, int num_threads,
+                         double centrex, double centrey, double size)
+{
+  static pert_float_t ref_orbit[2][2 * 0xe0];
+  FractalBuffer single, shared;
+  setup_fractal(&single, iter_buff[0], centrex, centrey, size);
+  single.mode = mode;
+  single.use_perturbation = use_perturbation;
+  single.ref_orbit = ref_orbit[0];
+  init_fractal(&single);
+  generate_fractal(&single);
+  CHECK(single.done, "single worker didn't set done");
+
+  shared = single;
+  shared.buff = iter_buff[1];
+  shared.ref_orbit = ref_orbit[1];
+  init_fractal(&shared);
+  generate_fractal_threads(&shared, num_threads);
+  CHECK(shared.done, "%d workers didn't set done", num_threads);
+
+  int diffs = 0;
+  for (int i = 0; i < IMAGE_ROWS * IMAGE_COLS; ++i) {
+    if (single.buff[i] != shared.buff[i]) ++diffs;
+  }
+  CHECK(diffs == 0, "%d pixels differ with %d workers", diffs, num_threads);
+  CHECK(single.count_inside == shared.count_inside, "count_inside %u, expected %u",
+        shared.count_inside, single.count_inside);
+  CHECK(single.min_iter == shared.min_iter, "min_iter %u, expected %u", shared.min_iter, single.min_iter);
+  CHECK(single.glitch_count == shared.glitch_count, "glitch_count %u, expected %u",
+        shared.glitch_count, single.glitch_count);
+  CHECK(single.iterations == shared.iterations, "iterations %u, expected %u",
+        shared.iterations, single.iterations);
+
+  uint32_t pixels = 0;
+  for (int w = 0; w < FRACTAL_MAX_WORKERS; ++w) pixels += shared.workers[w].pixels;
+  if (mode == FRACTAL_MODE_RASTER) {
+    CHECK(pixels == IMAGE_ROWS * IMAGE_COLS, "workers generated %u pixels", pixels);
+  }
+}
+
+// The tiled layout must hold the same image as row major
+static void test_layout(fractal_mode_t mode, double centrex, double centrey, double size)
+{
+  FractalBuffer row, tiled;
+  setup_fractal(&row, iter_buff[0], centrex, centrey, size);
+  row.mode = mode;
+  generate(&row);
+
+  tiled = row;
+  tiled.buff = iter_buff[1];
+  tiled.layout = FRACTAL_LAYOUT_TILED;
+  generate(&tiled);
+
+  int diffs = 0;
+  for (int16_t i = 0; i < IMAGE_ROWS; ++i) {
+    for (int16_t j = 0; j < IMAGE_COLS; ++j) {
+      if (fractal_pixel(&row, i, j) != fractal_pixel(&tiled, i, j)) ++diffs;
+      if (fractal_pixel_index(&tiled, i, j) >= FRACTAL_TILED_BUFFER_SIZE(IMAGE_ROWS, IMAGE_COLS)) ++diffs;
+    }
+  }
+  CHECK(diffs == 0, "%d pixels differ in the tiled layout", diffs);
+  CHECK(row.count_inside == tiled.count_inside, "count_inside %u, expected %u",
+        tiled.count_inside, row.count_inside);
+}
+
+// Adam7 pass, counting from 1, that generates pixel (i, j)
+static int adam7_pass(int16_t i, int16_t j)
+{
+  static const uint8_t pass[8][8] = {
+    { 1, 6, 4, 6, 2, 6, 4, 6 },
+    { 7, 7, 7, 7, 7, 7, 7, 7 },
+    { 5, 6, 5, 6, 5, 6, 5, 6 },
+    { 7, 7, 7, 7, 7, 7, 7, 7 },
+    { 3, 6, 4, 6, 3, 6, 4, 6 },
+    { 7, 7, 7, 7, 7, 7, 7, 7 },
+    { 5, 6, 5, 6, 5, 6, 5, 6 },
+    { 7, 7, 7, 7, 7, 7, 7, 7 },
+  };
+  return pass[i & 7][j & 7];
+}
+
+// Progressive generation must give the raster image, and the approximation
+// after each pass must only use pixels generated by then
+static void test_progressive(double centrex, double centrey, double size)
+{
+  FractalBuffer raster, progressive;
+  setup_fractal(&raster, iter_buff[0], centrex, centrey, size);
+  generate(&raster);
+  CHECK(raster.passes_done == FRACTAL_PASSES, "raster passes_done %d", raster.passes_done);
+
+  progressive = raster;
+  progressive.buff = iter_buff[1];
+  progressive.mode = FRACTAL_MODE_PROGRESSIVE;
+  generate(&progressive);
+  CHECK(progressive.passes_done == FRACTAL_PASSES, "progressive passes_done %d", progressive.passes_done);
+
+  int diffs = 0;
+  for (int i = 0; i < IMAGE_ROWS * IMAGE_COLS; ++i) {
+    if (raster.buff[i] != progressive.buff[i]) ++diffs;
+  }
+  CHECK(diffs == 0, "%d pixels differ from raster", diffs);
+  CHECK(raster.count_inside == progressive.count_inside, "count_inside %u, expected %u",
+        progressive.count_inside, raster.count_inside);
+
+  // Label each pixel with its pass, then check that after each pass only
+  // pixels from that pass or earlier are read
+  FractalBuffer passes_buff = progressive;
+  passes_buff.buff = iter_buff[2];
+  for (int16_t i = 0; i < IMAGE_ROWS; ++i) {
+    for (int16_t j = 0; j < IMAGE_COLS; ++j) {
+      *fractal_pixel_ptr(&passes_buff, i, j) = adam7_pass(i, j);
+    }
+  }
+  for (uint8_t passes = 1; passes <= FRACTAL_PASSES; ++passes) {
+    int bad = 0;
+    for (int16_t i = 0; i < IMAGE_ROWS; ++i) {
+      for (int16_t j = 0; j < IMAGE_COLS; ++j) {
+        if (fractal_progressive_pixel(&passes_buff, passes, i, j) > passes) ++bad;
+      }
+    }
+    CHECK(bad == 0, "%d pixels read from later passes after %d passes", bad, passes);
+  }
+}
+
+// The fixed point SIMD kernel must give exactly the scalar Q6.26 output
+static void test_simd(fractal_mode_t mode, double centrex, double centrey, double size)
+{
+  FractalBuffer scalar, simd;
+  setup_fractal(&scalar, iter_buff[0], centrex, centrey, size);
+  scalar.mode = mode;
+  scalar.precision = FRACTAL_PRECISION_Q6_26;
+  mandel_simd_enabled = false;
+  generate(&scalar);
+
+  simd = scalar;
+  simd.buff = iter_buff[1];
+  mandel_simd_enabled = true;
+  generate(&simd);
+
+  int diffs = 0;
+  for (int i = 0; i < IMAGE_ROWS * IMAGE_COLS; ++i) {
+    if (scalar.buff[i] != simd.buff[i]) ++diffs;
+  }
+#if MANDEL_SIMD_DOUBLE
+  // Iterating in double precision only moves the edges of escape bands
+  CHECK(diffs < IMAGE_ROWS * IMAGE_COLS / 10, "%d pixels differ from scalar", diffs);
+#else
+  CHECK(diffs == 0, "%d pixels differ from scalar", diffs);
+  CHECK(scalar.count_inside == simd.count_inside, "count_inside %u, expected %u",
+        simd.count_inside, scalar.count_inside);
+  CHECK(scalar.min_iter == simd.min_iter, "min_iter %u, expected %u", simd.min_iter, scalar.min_iter);
+#endif
+}
+
+// Interior checks must save iterations without changing more than a
+// handful of pixels next to the boundary
+static void test_interior_check(bool use_derivative_check, double centrex, double centrey, double size)
+{
+  FractalBuffer plain, checked;
+  setup_fractal(&plain, iter_buff[0], centrex, centrey, size);
+  plain.precision = FRACTAL_PRECISION_Q6_26;
+  generate(&plain);
+
+  checked = plain;
+  checked.buff = iter_buff[1];
+  checked.use_cycle_check = !use_derivative_check;
+  checked.use_derivative_check = use_derivative_check;
+  generate(&checked);
+
+  int diffs = 0;
+  for (int i = 0; i < IMAGE_ROWS * IMAGE_COLS; ++i) {
+    if (plain.buff[i] != checked.buff[i]) ++diffs;
+  }
+  CHECK(diffs * 10000 <= IMAGE_ROWS * IMAGE_COLS, "%d pixels differ with interior checking", diffs);
+  CHECK(checked.cycle_count > 0 && checked.cycle_iters_saved >= checked.cycle_count,
+        "%u cycles saved %u iterations", checked.cycle_count, checked.cycle_iters_saved);
+  CHECK(plain.cycle_count == 0, "%u cycles found without checking", plain.cycle_count);
+}
+
+// Escape count of the pixel at (x, y) iterated in doubles, as the kernels
+// count it
+static uint16_t formula_escape(const FractalBuffer* f, double x, double y)
+{
+  double cx = x, cy = y;
+  if (f->formula == FRACTAL_FORMULA_JULIA) {
+    cx = f->julia_cx;
+    cy = f->julia_cy;
+  }
+  uint16_t k = 1;
+  for (; k < f->max_iter; ++k) {
+    if (x * x + y * y > 4.0) break;
+    double nextx;
+    if (f->formula == FRACTAL_FORMULA_MULTIBROT3) {
+      nextx = x * (x * x - 3 * y * y) + cx;
+      y = y * (3 * x * x - y * y) + cy;
+    } else {
+      nextx = x * x - y * y + cx;
+      y = (f->formula == FRACTAL_FORMULA_BURNING_SHIP ? 2 * fabs(x * y) : 2 * x * y) + cy;
+    }
+    x = nextx;
+  }
+  return k == f->max_iter ? 0 : k;
+}
+
+// Each formula's kernels must match iterating in doubles, apart from the
+// pixels whose orbits are chaotic enough for rounding to change them, and
+// Mariani-Silver and the interior checks must give the same image as the
+// raster
+static void test_formula(fractal_formula_t formula, fractal_precision_t precision,
+                         double centrex, double centrey, double size)
+{
+  FractalBuffer raster, other;
+  setup_fractal(&raster, iter_buff[0], centrex, centrey, size);
+  raster.max_iter = 0x40;
+  raster.formula = formula;
+  raster.julia_cx = -0.8;
+  raster.julia_cy = 0.156;
+  raster.precision = precision;
+  generate(&raster);
+
+  int diffs = 0;
+  for (int16_t i = 0; i < IMAGE_ROWS; ++i) {
+    for (int16_t j = 0; j < IMAGE_COLS; ++j) {
+      double x = raster.minx + j * (raster.maxx - raster.minx) / (IMAGE_COLS - 1);
+      double y = raster.miny + i * (raster.maxy - raster.miny) / (IMAGE_ROWS - 1);
+      if (fractal_pixel(&raster, i, j) != formula_escape(&raster, x, y)) ++diffs;
+    }
+  }
+  CHECK(diffs * 50 <= IMAGE_ROWS * IMAGE_COLS, "%d pixels of formula %d differ from doubles", diffs, formula);
+  CHECK(raster.count_inside > 0 && raster.count_inside < IMAGE_ROWS * IMAGE_COLS,
+        "formula %d has %u pixels inside", formula, raster.count_inside);
+
+  for (int variant = 0; variant < 3; ++variant) {
+    other = raster;
+    other.buff = iter_buff[1];
+    other.mode = (variant == 0) ? FRACTAL_MODE_MARIANI_SILVER : FRACTAL_MODE_RASTER;
+    other.use_cycle_check = (variant == 1);
+    other.use_derivative_check = (variant == 2);
+    generate(&other);
+
+    diffs = 0;
+    for (int i = 0; i < IMAGE_ROWS * IMAGE_COLS; ++i) {
+      if (raster.buff[i] != other.buff[i]) ++diffs;
+    }
+    CHECK(diffs * 1000 <= IMAGE_ROWS * IMAGE_COLS, "%d pixels of formula %d differ in variant %d",
+          diffs, formula, variant);
+  }
+
+  // Q4.60 and perturbation are only for the Mandelbrot set, so other
+  // formulas fall back to Q4.28
+  if (formula != FRACTAL_FORMULA_MANDELBROT) {
+    other = raster;
+    other.buff = iter_buff[1];
+    other.precision = FRACTAL_PRECISION_Q4_60;
+    other.use_perturbation = true;
+    generate(&other);
+    CHECK(other.active_precision == FRACTAL_PRECISION_Q4_28, "formula %d used precision %d",
+          formula, other.active_precision);
+  }
+}
+
+// The kernel chosen for each pixel step must match iterating in doubles,
+// apart from the pixels whose orbits are chaotic enough for rounding to
+// change them, down past the end of the Q6.26 kernel
+static void test_precision(double centrex, double centrey)
+{
+  for (double size = 0.0003; size > 0.000005; size *= 0.5) {
+    FractalBuffer f;
+    setup_fractal(&f, iter_buff[0], centrex, centrey, size);
+    generate(&f);
+
+    int diffs = 0;
+    for (int16_t i = 0; i < IMAGE_ROWS; ++i) {
+      for (int16_t j = 0; j < IMAGE_COLS; ++j) {
+        double x = f.minx + j * (f.maxx - f.minx) / (IMAGE_COLS - 1);
+        double y = f.miny + i * (f.maxy - f.miny) / (IMAGE_ROWS - 1);
+        if (fractal_pixel(&f, i, j) != formula_escape(&f, x, y)) ++diffs;
+      }
+    }
+    CHECK(diffs * 50 <= IMAGE_ROWS * IMAGE_COLS, "%d pixels differ from doubles at size %g with precision %d",
+          diffs, size, f.active_precision);
+  }
+}
+
+// Escape count of the Mandelbrot set pixel at (x, y) iterated in long
+// doubles, which unlike doubles stay exact for all but a few in 10000 of
+// the pixels at 1e-12
+static uint16_t mandelbrot_escape_long(const FractalBuffer* f, long double x, long double y)
+{
+  long double cx = x, cy = y;
+  uint16_t k = 1;
+  for (; k < f->max_iter; ++k) {
+    if (x * x + y * y > 4.0L) break;
+    long double nextx = x * x - y * y + cx;
+    y = 2 * x * y + cy;
+    x = nextx;
+  }
+  return k == f->max_iter ? 0 : k;
+}
+
+// Perturbed pixels must match iterating in long doubles from 1e-7 down to
+// 1e-12, apart from the few orbits chaotic enough for rounding to change
+// them.  Where the reference orbit escapes before the pixels do, the
+// rebased and recomputed pixels must match as well.
+static void test_perturbation(double centrex, double centrey, int max_depth, bool expect_glitches)
+{
+  static pert_float_t ref_orbit[2 * 0x200];
+  for (int depth = 7; depth <= max_depth; ++depth) {
+    FractalBuffer f;
+    setup_fractal(&f, (uint8_t*)iter16_buff[0], centrex, centrey, pow(10, -depth));
+    f.iter16 = true;
+    f.max_iter = 0x200;
+    f.use_perturbation = true;
+    f.ref_orbit = ref_orbit;
+    generate(&f);
+
+    int diffs = 0;
+    for (int16_t i = 0; i < IMAGE_ROWS; ++i) {
+      for (int16_t j = 0; j < IMAGE_COLS; ++j) {
+        long double x = f.minx + j * ((long double)f.maxx - f.minx) / (IMAGE_COLS - 1);
+        long double y = f.miny + i * ((long double)f.maxy - f.miny) / (IMAGE_ROWS - 1);
+        if (fractal_pixel(&f, i, j) != mandelbrot_escape_long(&f, x, y)) ++diffs;
+      }
+    }
+    CHECK(diffs * 500 <= IMAGE_ROWS * IMAGE_COLS, "%d perturbed pixels differ from long doubles at size 1e-%d",
+          diffs, depth);
+    CHECK(!expect_glitches || f.glitch_count > 0, "no glitches at size 1e-%d", depth);
+  }
+}
+
+// A 16-bit buffer must hold the same values as an 8-bit one while they fit
+static void test_iter16(fractal_mode_t mode, double centrex, double centrey, double size)
+{
+  FractalBuffer narrow, wide;
+  setup_fractal(&narrow, iter_buff[0], centrex, centrey, size);
+  narrow.mode = mode;
+  generate(&narrow);
+
+  wide = narrow;
+  wide.buff = (uint8_t*)iter16_buff[0];
+  wide.iter16 = true;
+  generate(&wide);
+
+  int diffs = 0;
+  for (int i = 0; i < IMAGE_ROWS * IMAGE_COLS; ++i) {
+    if (narrow.buff[i] != iter16_buff[0][i]) ++diffs;
+  }
+  CHECK(diffs == 0, "%d pixels differ in a 16-bit buffer", diffs);
+  CHECK(narrow.min_iter == wide.min_iter, "min_iter %u, expected %u", wide.min_iter, narrow.min_iter);
+}
+
+// The window chosen from a saturated frame must raise max_iter, and the
+// values stored must be the escape iterations less iter_offset
+static void test_iteration_window(bool iter16, double centrex, double centrey, double size)
+{
+  FractalBuffer prev, next, full;
+  setup_fractal(&prev, iter_buff[0], centrex, centrey, size);
+  generate(&prev);
+
+  setup_fractal(&next, iter16 ? (uint8_t*)iter16_buff[0] : iter_buff[1], centrex, centrey, size * 0.85);
+  next.iter16 = iter16;
+  choose_iteration_window(&next, &prev, 0x40, 0x800);
+  CHECK(next.max_iter > prev.max_iter, "max_iter %u not raised from %u", next.max_iter, prev.max_iter);
+  CHECK(next.iter_offset > 0, "iter_offset not raised");
+  CHECK(iter16 || next.max_iter - next.iter_offset <= 256, "window %u-%u doesn't fit 8 bits",
+        next.iter_offset, next.max_iter);
+  generate(&next);
+
+  full = next;
+  full.buff = (uint8_t*)iter16_buff[1];
+  full.iter16 = true;
+  full.iter_offset = 0;
+  generate(&full);
+
+  int diffs = 0;
+  for (int16_t i = 0; i < IMAGE_ROWS; ++i) {
+    for (int16_t j = 0; j < IMAGE_COLS; ++j) {
+      uint16_t k = fractal_pixel(&full, i, j);
+      if (k != 0) k = MAX(1, k - next.iter_offset);
+      if (fractal_pixel(&next, i, j) != k) ++diffs;
+    }
+  }
+  CHECK(diffs == 0, "%d pixels differ with iter_offset %u", diffs, next.iter_offset);
+}
+
+// The histogram built during generation must match a count of the buffer
+static void check_histogram(const FractalBuffer* f, const char* name)
+{
+  uint32_t hist[FRACTAL_HISTOGRAM_BINS] = { 0 };
+  for (int16_t i = 0; i < f->rows; ++i) {
+    for (int16_t j = 0; j < f->cols; ++j) {
+      hist[fractal_pixel(f, i, j) >> f->histogram_shift]++;
+    }
+  }
+
+  int diffs = 0;
+  for (int b = 0; b < FRACTAL_HISTOGRAM_BINS; ++b) {
+    if (hist[b] != f->histogram[b]) ++diffs;
+  }
+  CHECK(diffs == 0, "%d histogram bins differ from a recount with %s", diffs, name);
+  CHECK(f->histogram[0] >= f->count_inside && (f->histogram_shift || f->histogram[0] == f->count_inside),
+        "histogram has %u in bin 0, with %u inside with %s", f->histogram[0], f->count_inside, name);
+}
+
+static void test_histogram(double centrex, double centrey, double size)
+{
+  static const char* mode_names[] = { "raster", "mariani-silver", "progressive" };
+  FractalBuffer f, prev;
+  for (int mode = FRACTAL_MODE_RASTER; mode <= FRACTAL_MODE_PROGRESSIVE; ++mode) {
+    setup_fractal(&f, iter_buff[0], centrex, centrey, size);
+    f.mode = mode;
+    init_fractal(&f);
+    generate_fractal_threads(&f, 2);
+    check_histogram(&f, mode_names[mode]);
+  }
+
+  // Reused samples
+  setup_fractal(&prev, iter_buff[1], centrex, centrey, 2 * size);
+  snap_fractal_viewport(&prev, NULL, 2);
+  generate(&prev);
+  setup_fractal(&f, iter_buff[0], centrex, centrey, size);
+  f.mode = FRACTAL_MODE_MARIANI_SILVER;
+  snap_fractal_viewport(&f, &prev, 2);
+  f.reuse_from = &prev;
+  generate(&f);
+  check_histogram(&f, "reuse");
+
+  // A 16-bit window wider than the bins
+  setup_fractal(&f, (uint8_t*)iter16_buff[0], centrex, centrey, size);
+  f.iter16 = true;
+  f.max_iter = 0x400;
+  f.mode = FRACTAL_MODE_MARIANI_SILVER;
+  generate(&f);
+  CHECK(f.histogram_shift == 2, "histogram_shift %u for 0x400 iterations", f.histogram_shift);
+  check_histogram(&f, "iter16");
+}
+
+// Every escaped value of a 16-bit window wider than the bins must get an
+// equalised colour, including those below 1 << histogram_shift that share
+// bin 0 with the pixels inside
+static void test_equalise(double centrex, double centrey, double size)
+{
+  FractalBuffer f;
+  setup_fractal(&f, (uint8_t*)iter16_buff[0], centrex, centrey, size);
+  f.iter16 = true;
+  f.max_iter = 0x200;
+  generate(&f);
+  CHECK(f.histogram_shift > 0 && f.histogram[0] > f.count_inside,
+        "bin 0 has %u pixels, %u inside, with histogram_shift %u", f.histogram[0], f.count_inside, f.histogram_shift);
+
+  const uint16_t colours = 0xdf;
+  uint16_t entries[FRACTAL_HISTOGRAM_BINS] = { 0 };
+  CHECK(fractal_equalise_histogram(&f, colours, entries), "no pixels escaped");
+  int bad = 0;
+  for (int k = 1; k < f.max_iter - f.iter_offset; ++k) {
+    uint16_t entry = entries[MIN(k >> f.histogram_shift, FRACTAL_HISTOGRAM_BINS - 1)];
+    if (entry < 1 || entry > colours) ++bad;
+  }
+  CHECK(bad == 0, "%d escape values have no colour", bad);
+}
+
+static double smooth_count(const FractalBuffer* f, int index)
+{
+  return f->buff[index] + f->smooth[index] / 256.0;
+}
+
+// Smoothed escape counts must be continuous across the steps between
+// bands, and the same with Mariani-Silver and several workers
+static void test_smooth(double centrex, double centrey, double size)
+{
+  FractalBuffer raster, ms;
+  setup_fractal(&raster, iter_buff[0], centrex, centrey, size);
+  raster.smooth = smooth_buff[0];
+  generate(&raster);
+
+  // Compare the change across each step of 1 between two runs of equal
+  // values with the change within the runs either side
+  double total = 0;
+  int steps = 0;
+  for (int i = 0; i < IMAGE_ROWS; ++i) {
+    for (int j = 1; j < IMAGE_COLS - 2; ++j) {
+      int p = i * IMAGE_COLS + j;
+      uint8_t k0 = raster.buff[p], k1 = raster.buff[p + 1];
+      if (k0 == 0 || k1 == 0 || abs(k0 - k1) != 1) continue;
+      if (raster.buff[p - 1] != k0 || raster.buff[p + 2] != k1) continue;
+      double before = smooth_count(&raster, p) - smooth_count(&raster, p - 1);
+      double after = smooth_count(&raster, p + 2) - smooth_count(&raster, p + 1);
+      double step = smooth_count(&raster, p + 1) - smooth_count(&raster, p);
+      total += fabs(step - 0.5 * (before + after));
+      ++steps;
+    }
+  }
+  CHECK(steps > 100, "only %d steps between bands", steps);
+  CHECK(total < 0.1 * steps, "mean discontinuity %.3f at %d steps", total / steps, steps);
+
+  ms = raster;
+  ms.buff = iter_buff[1];
+  ms.smooth = smooth_buff[1];
+  ms.mode = FRACTAL_MODE_MARIANI_SILVER;
+  init_fractal(&ms);
+  generate_fractal_threads(&ms, 2);
+
+  int diffs = 0;
+  for (int i = 0; i < IMAGE_ROWS * IMAGE_COLS; ++i) {
+    if (raster.buff[i] != ms.buff[i] || raster.smooth[i] != ms.smooth[i]) ++diffs;
+  }
+  // As without smoothing, Mariani-Silver can fill in a few filaments
+  CHECK(diffs * 1000 <= IMAGE_ROWS * IMAGE_COLS, "%d smoothed pixels differ with Mariani-Silver", diffs);
+}
+
+// Bilinear scaling must give the nearest sample at sample positions, blend
+// between them elsewhere, and not blend in samples inside the set
+static void test_bilinear()
+{
+  const int bits = 2;
+  uint16_t palette[256 << bits];
+  for (int i = 0; i < (256 << bits); ++i) palette[i] = i;
+
+  FractalBuffer f;
+  memset(&f, 0, sizeof(f));
+  f.buff = iter_buff[0];
+  f.rows = 4;
+  f.cols = 4;
+  static const uint8_t values[16] = {
+    10, 11, 12, 0,
+    12, 13, 14, 0,
+    20, 20, 0,  0,
+    20, 20, 0,  0,
+  };
+  memcpy(f.buff, values, sizeof(values));
+
+  const int32_t one = 1 << SCALE_FIXED_PT;
+  uint16_t row[8];
+  scale_row_bilinear(&f, palette, bits, 0, 0, one, 4, row);
+  for (int j = 0; j < 4; ++j) {
+    CHECK(row[j] == values[j] << bits, "pixel %d is %d, expected %d", j, row[j], values[j] << bits);
+  }
+
+  scale_row_bilinear(&f, palette, bits, 0, one / 2, one, 2, row);
+  CHECK(row[0] == ((10 << bits) | 2), "half way between 10 and 11 is %d", row[0]);
+  CHECK(row[1] == ((11 << bits) | 2), "half way between 11 and 12 is %d", row[1]);
+
+  // Between 10, 11, 12 and 13
+  scale_row_bilinear(&f, palette, bits, one / 2, one / 2, one, 1, row);
+  CHECK(row[0] == (11 << bits) + (1 << bits) / 2, "centre of 10-13 is %d", row[0]);
+
+  // Inside neighbours take the value of the top left sample
+  scale_row_bilinear(&f, palette, bits, one + one / 2, 2 * one + one / 2, one, 1, row);
+  CHECK(row[0] == 14 << bits, "next to inside is %d, expected %d", row[0], 14 << bits);
+  scale_row_bilinear(&f, palette, bits, 2 * one + one / 2, 2 * one + one / 2, one, 1, row);
+  CHECK(row[0] == 0, "inside is %d", row[0]);
+
+  // Positions past the last row and column use the edge samples
+  scale_row_bilinear(&f, palette, bits, 3 * one + one / 2, one + one / 2, one, 1, row);
+  CHECK(row[0] == 20 << bits, "past the edge is %d, expected %d", row[0], 20 << bits);
+}
+
+// The display sampler in main.c pops interpolator 0 for the address of
+// each buffer sample, which must step through the same columns as the
+// column_map the tiled layout uses
+static void test_interp_columns(int pixel_bytes, int32_t x_start, int32_t x_step, int jmin, int jmax)
+{
+  const int fixed_pt = 22;  // ITERATION_FIXED_PT in main.c
+  const uint pixel_shift = pixel_bytes - 1;
+  interp_config cfg = interp_default_config();
+  interp_config_set_add_raw(&cfg, true);
+  interp_config_set_shift(&cfg, fixed_pt - pixel_shift);
+  interp_config_set_mask(&cfg, pixel_shift, 31 - fixed_pt + pixel_shift);
+  interp_config_set_signed(&cfg, true);
+  interp_set_config(interp0, 0, &cfg);
+  interp0->base[1] = 0;
+  interp0->accum[1] = 0;
+  interp0->base[0] = x_step;
+
+  const uint8_t* row = iter_buff[0] + IMAGE_COLS * pixel_bytes;
+  interp0->accum[0] = x_start + jmin * x_step;
+  interp0->base[2] = (uintptr_t)row;
+  int diffs = 0;
+  for (int j = jmin; j < jmax; ++j) {
+    const uint8_t* sample = (const uint8_t*)(uintptr_t)interp_pop_full_result(interp0);
+    uint16_t column_map = (x_start + j * x_step) >> fixed_pt;
+    if (sample != row + column_map * pixel_bytes) ++diffs;
+  }
+  CHECK(diffs == 0, "%d of %d interpolated %d-byte samples differ from the column map", diffs, jmax - jmin,
+        pixel_bytes);
+}
+
+// Bilinear scaling must give the same rows from either layout
+static void test_bilinear_layout(double centrex, double centrey, double size)
+{
+  FractalBuffer row_major, tiled;
+  uint16_t palette[256 << 2];
+  for (int i = 0; i < (256 << 2); ++i) palette[i] = i * 37;
+
+  setup_fractal(&row_major, iter_buff[0], centrex, centrey, size);
+  generate(&row_major);
+  tiled = row_major;
+  tiled.buff = iter_buff[1];
+  tiled.layout = FRACTAL_LAYOUT_TILED;
+  generate(&tiled);
+
+  int diffs = 0;
+  int32_t step = (int32_t)(0.7 * (1 << SCALE_FIXED_PT));
+  for (int32_t y = 0; y < (IMAGE_ROWS - 1) << SCALE_FIXED_PT; y += step) {
+    uint16_t a[240], b[240];
+    scale_row_bilinear(&row_major, palette, 2, y, 1 << SCALE_FIXED_PT, step, 240, a);
+    scale_row_bilinear(&tiled, palette, 2, y, 1 << SCALE_FIXED_PT, step, 240, b);
+    diffs += memcmp(a, b, sizeof(a)) != 0;
+  }
+  CHECK(diffs == 0, "%d rows differ between layouts", diffs);
+}
+
+// Records must survive the ring and the framing, with junk between frames
+static void test_telemetry(double centrex, double centrey, double size)
+{
+  FractalBuffer f;
+  setup_fractal(&f, iter_buff[0], centrex, centrey, size);
+  f.use_cycle_check = true;
+  generate(&f);
+
+  TelemetryRecord record = { 0 };
+  telemetry_fill(&record, &f);
+  CHECK(record.pixels_core0 + record.pixels_core1 == IMAGE_ROWS * IMAGE_COLS,
+        "cores generated %u pixels", record.pixels_core0 + record.pixels_core1);
+  CHECK(record.iterations > record.cycle_iters_saved, "%u iterations, %u saved",
+        record.iterations, record.cycle_iters_saved);
+
+  // Overfill the ring, then read it out in odd sized pieces with a junk
+  // byte that looks like the start of a frame between frames
+  const int pushed = TELEMETRY_RING_SIZE + 5;
+  for (int n = 0; n < pushed; ++n) {
+    record.generate_us = 1000 * n;
+    record.frames = n;
+    record.clamps = n;
+    record.border_rows = 240 * n;
+    telemetry_push(&record);
+  }
+  static uint8_t stream[2 * TELEMETRY_RING_SIZE * TELEMETRY_FRAME_SIZE];
+  int len = 0, got, frame_pos = 0;
+  while ((got = telemetry_read(stream + len, MIN(7, TELEMETRY_FRAME_SIZE - frame_pos))) > 0) {
+    len += got;
+    frame_pos += got;
+    if (frame_pos == TELEMETRY_FRAME_SIZE) {
+      stream[len++] = 0xa5;
+      frame_pos = 0;
+    }
+  }
+  CHECK(telemetry_read(stream + len, 1) == 0, "ring not empty");
+
+  // Corrupt the third frame
+  stream[2 * (TELEMETRY_FRAME_SIZE + 1) + 20] ^= 1;
+
+  int decoded = 0, pos = 0, used;
+  TelemetryRecord r;
+  while ((used = telemetry_decode(stream + pos, len - pos, &r)) > 0) {
+    pos += used;
+    int n = decoded < 2 ? decoded : decoded + 1;
+    CHECK(r.sequence == n && r.generate_us == 1000u * n && r.frames == n && r.clamps == n &&
+          r.border_rows == 240u * n,
+          "record %d has sequence %u, generate_us %u", n, r.sequence, r.generate_us);
+    CHECK(r.iterations == record.iterations && r.pixels_core1 == record.pixels_core1 &&
+          r.max_iter == record.max_iter && r.dma_stall_us == record.dma_stall_us,
+          "record %d fields differ", n);
+    ++decoded;
+  }
+  CHECK(decoded == TELEMETRY_RING_SIZE - 1, "decoded %d records, expected %d", decoded, TELEMETRY_RING_SIZE - 1);
+
+  // The next record reports the ones dropped while the ring was full
+  telemetry_push(&record);
+  got = telemetry_read(stream, TELEMETRY_FRAME_SIZE);
+  CHECK(got == TELEMETRY_FRAME_SIZE && telemetry_decode(stream, got, &r) == got, "frame not decoded");
+  CHECK(r.sequence == pushed && r.dropped == pushed - TELEMETRY_RING_SIZE,
+        "sequence %u, dropped %u", r.sequence, r.dropped);
+}
+
+// Joystick and buttons a scripted Nunchuck gives each frame
+static InputState scripted_input(int frame)
+{
+  InputState s = { 0 };
+  s.joyx = frame / 7 % 2 ? -100 : 3;
+  s.joyy = frame / 11 * 5 - 60;
+  s.zbutton = frame % 13 == 0;
+  s.cbutton = frame % 17 == 0;
+  return s;
+}
+
+static int script_frame;
+
+static void read_script(InputState* s)
+{
+  *s = scripted_input(script_frame);
+}
+
+// Frame every part of the trace that can be sent into stream, with junk
+// and a telemetry frame between
+static int read_input_frames(InputTrace* t, uint8_t* stream)
+{
+  int len = 0, got;
+  while ((got = input_read(t, stream + len)) > 0) {
+    len += got;
+    stream[len++] = 0xa5;
+    stream[len++] = 0x5a;
+  }
+  TelemetryRecord record = { 0 };
+  telemetry_push(&record);
+  len += telemetry_read(stream + len, TELEMETRY_FRAME_SIZE);
+  return len;
+}
+
+// Generations of the zoom a trace is recorded or replayed over
+static void input_trace_view(FractalBuffer* f, int generation)
+{
+  double size = 3.0 * pow(0.85, generation);
+  f->minx = -0.75 - size;
+  f->maxx = -0.75 + size;
+  f->miny = 0.1 - size;
+  f->maxy = 0.1 + size;
+  f->max_iter = 0x100 + generation;
+  f->iter_offset = generation;
+}
+
+// A recorded trace must come through the framing with other frames and
+// junk in the stream, replay the same seed, inputs and ready flags, and
+// catch a viewport that differs or a chunk that is lost
+static void test_input_trace()
+{
+  const int generations = 6, frames = 40;
+  static uint8_t stream[16384];
+  int len = 0;
+  InputTrace t;
+  input_init(&t, INPUT_RECORD, read_script, NULL, 0);
+  CHECK(input_seed(&t, 0x12345678) == 0x12345678, "recorded seed changed");
+  FractalBuffer f;
+  for (int g = 0; g < generations; ++g) {
+    input_trace_view(&f, g);
+    input_check_view(&t, &f);
+    for (int n = 0; n < frames; ++n) {
+      script_frame = g * frames + n;
+      InputState s;
+      input_poll(&t, &s);
+      InputState expect = scripted_input(script_frame);
+      CHECK(s.joyx == expect.joyx && s.joyy == expect.joyy && s.zbutton == expect.zbutton &&
+            s.cbutton == expect.cbutton, "live input changed");
+      input_ready(&t, n == frames - 1);
+    }
+    len += read_input_frames(&t, stream + len);
+  }
+  CHECK(t.mode == INPUT_RECORD && t.generations == generations, "recording stopped");
+
+  static uint8_t trace[16384];
+  int trace_len = input_extract(stream, len, trace, sizeof(trace));
+  CHECK(trace_len > 0 && trace_len < generations * frames * 4, "trace of %d bytes", trace_len);
+
+  for (int diverge = 0; diverge < 2; ++diverge) {
+    input_init(&t, INPUT_REPLAY, read_script, trace, trace_len);
+    script_frame = 1;  // Live inputs mustn't be used
+    CHECK(input_seed(&t, 1) == 0x12345678, "seed not replayed");
+    int ready_frames = 0;
+    for (int g = 0; g < generations - 1; ++g) {
+      input_trace_view(&f, g);
+      if (diverge && g == 3) f.maxx *= 1.0000001;
+      input_check_view(&t, &f);
+      for (int n = 0; n < frames; ++n) {
+        InputState s, expect = scripted_input(g * frames + n);
+        input_poll(&t, &s);
+        CHECK(s.joyx == expect.joyx && s.joyy == expect.joyy && s.zbutton == expect.zbutton &&
+              s.cbutton == expect.cbutton, "frame %d input differs", g * frames + n);
+        if (input_ready(&t, false)) ready_frames += n == frames - 1 ? 1 : 100;
+      }
+    }
+    CHECK(ready_frames == generations - 1, "%d frames ready", ready_frames);
+
+    // The trace ends part way through the last generation
+    input_trace_view(&f, generations - 1);
+    input_check_view(&t, &f);
+    InputState s;
+    for (int n = 0; n < frames && !t.ended; ++n) {
+      input_poll(&t, &s);
+      input_ready(&t, false);
+    }
+    CHECK(t.ended, "replay didn't end");
+    CHECK(t.mismatches == diverge && t.generations == generations,
+          "%u of %u generations off the path", t.mismatches, t.generations);
+  }
+
+  // A corrupted chunk ends the trace before it.  The first chunk is full.
+  stream[10] ^= 1;
+  CHECK(input_extract(stream, len, trace, sizeof(trace)) == 0, "trace extracted past a bad chunk");
+  stream[10] ^= 1;
+  stream[INPUT_FRAME_MAX + 2 + 10] ^= 1;
+  int short_len = input_extract(stream, len, trace, sizeof(trace));
+  CHECK(short_len > 0 && short_len < trace_len, "trace of %d bytes after a bad chunk", short_len);
+}
+
+// Samples copied from the tile cache, at the same level or one either
+// side, must match a full recompute.  Mariani-Silver fills can copy the
+// odd filled pixel that a recompute would iterate, so a few may differ.
+static void test_cache(fractal_mode_t mode, uint16_t num_tiles, double centrex, double centrey, double size)
+{
+  static FractalCacheTile tiles[8192];
+  static uint16_t buckets[1024];
+  FractalCache cache;
+  fractal_cache_init(&cache, tiles, num_tiles, buckets, 1024);
+
+  // Pan, zoom in, zoom out and go back to the start
+  static const double path[][3] = {
+    { 0, 0, 1 }, { 0.3, 0.1, 1 }, { 0.3, 0.1, 0.5 }, { 0.1, -0.2, 2 }, { 0, 0, 1 },
+  };
+  for (int step = 0; step < 5; ++step) {
+    FractalBuffer cached, full;
+    setup_fractal(&cached, iter_buff[0], centrex + path[step][0] * size, centrey + path[step][1] * size,
+                  path[step][2] * size);
+    cached.mode = mode;
+    cached.cache = &cache;
+    fractal_cache_snap_viewport(&cached);
+    generate(&cached);
+    CHECK(cached.cache_level >= 0, "step %d not on the cache grid", step);
+
+    full = cached;
+    full.buff = iter_buff[1];
+    full.cache = NULL;
+    generate(&full);
+
+    int diffs = 0;
+    for (int i = 0; i < IMAGE_ROWS * IMAGE_COLS; ++i) {
+      if (cached.buff[i] != full.buff[i]) ++diffs;
+    }
+    int max_diffs = mode == FRACTAL_MODE_RASTER ? 0 : IMAGE_ROWS * IMAGE_COLS / 1000;
+    CHECK(diffs <= max_diffs, "step %d: %d pixels differ from a full recompute", step, diffs);
+    if (step == 1) CHECK(cached.cache_hits > 0, "no cache hits after panning");
+    if (step == 4 && num_tiles >= 5 * IMAGE_ROWS * IMAGE_COLS / 64) {
+      CHECK(cached.cache_hits >= cached.cache_lookups * 9 / 10, "revisit hit %u of %u",
+            cached.cache_hits, cached.cache_lookups);
+    }
+    fractal_cache_store(&cached);
+    CHECK(fractal_cache_bytes_used(&cache) <= num_tiles * sizeof(FractalCacheTile), "cache holds %u bytes",
+          fractal_cache_bytes_used(&cache));
+  }
+  if (num_tiles < IMAGE_ROWS * IMAGE_COLS / 64) CHECK(cache.evictions > 0, "no tiles evicted");
+}
+
+// Encoded buffers must decode to the image generated row major, at reduced
+// resolution only for rows that didn't fit in rle_data.  Mariani-Silver
+// bands are a different shape from its usual tiles, so it can fill a few
+// pixels differently.
+static void test_rle(fractal_mode_t mode, int num_threads, uint32_t rle_size,
+                     double centrex, double centrey, double size)
+{
+  static uint8_t rle_data[2 * IMAGE_ROWS * IMAGE_COLS];
+  static uint32_t rle_rows[IMAGE_ROWS];
+  FractalBuffer row, rle;
+  setup_fractal(&row, iter_buff[0], centrex, centrey, size);
+  row.mode = mode;
+  generate(&row);
+
+  rle = row;
+  rle.buff = iter_buff[1];
+  rle.layout = FRACTAL_LAYOUT_RLE;
+  rle.rle_data = rle_data;
+  rle.rle_size = rle_size;
+  rle.rle_rows = rle_rows;
+  init_fractal(&rle);
+  generate_fractal_threads(&rle, num_threads);
+  CHECK(rle.done, "%d workers didn't set done", num_threads);
+  CHECK(rle.bands_encoded == rle.tiles_y, "encoded %d of %d bands", rle.bands_encoded, rle.tiles_y);
+  CHECK(rle.rle_used <= rle_size, "used %u of %u bytes", rle.rle_used, rle_size);
+
+  int diffs = 0;
+  uint16_t reduced = 0;
+  for (int16_t i = 0; i < IMAGE_ROWS; ++i) {
+    uint8_t decoded[IMAGE_COLS];
+    fractal_rle_row(&rle, i, decoded);
+    uint8_t shift = rle_data[rle_rows[i]];
+    if (shift) ++reduced;
+    for (int16_t j = 0; j < IMAGE_COLS; ++j) {
+      if (decoded[j] != fractal_pixel(&row, i, (j >> shift) << shift)) ++diffs;
+    }
+  }
+  int max_diffs = (mode == FRACTAL_MODE_RASTER) ? 0 : IMAGE_ROWS * IMAGE_COLS / 1000;
+  CHECK(diffs <= max_diffs, "%d pixels differ after decoding", diffs);
+  CHECK(reduced == rle.rle_reduced_rows, "%u rows reduced, counted %u", reduced, rle.rle_reduced_rows);
+  if (rle_size >= FRACTAL_RLE_ROW_BYTES(IMAGE_COLS) * IMAGE_ROWS) {
+    CHECK(reduced == 0, "%u rows reduced with space for all", reduced);
+  } else {
+    CHECK(reduced > 0, "no rows reduced in %u bytes", rle_size);
+  }
+  if (mode == FRACTAL_MODE_RASTER) {
+    CHECK(row.count_inside == rle.count_inside, "count_inside %u, expected %u",
+          rle.count_inside, row.count_inside);
+    CHECK(row.iterations == rle.iterations, "iterations %u, expected %u", rle.iterations, row.iterations);
+  }
+
+  // The ring only holds the last bands, so the next window must come from
+  // what generation counted, and match the row major buffer's
+  FractalBuffer row_next = row, rle_next = rle;
+  choose_iteration_window(&row_next, &row, 0x40, 0x800);
+  choose_iteration_window(&rle_next, &rle, 0x40, 0x800);
+  CHECK(rle_next.max_iter == row_next.max_iter && rle_next.iter_offset == row_next.iter_offset,
+        "RLE window %u-%u, row major %u-%u", rle_next.iter_offset, rle_next.max_iter,
+        row_next.iter_offset, row_next.max_iter);
+}
+
+int main()
+{
+  mandel_init();
+
+  test_reuse(FRACTAL_MODE_RASTER, 2, -1.0, 0.0, 3.2);
+  test_reuse(FRACTAL_MODE_RASTER, 2, -1.01, -0.3125, 0.01);
+  test_reuse(FRACTAL_MODE_RASTER, 3, -0.75, 0.1, 0.2);
+  test_reuse(FRACTAL_MODE_MARIANI_SILVER, 2, -0.75, 0.1, 0.2);
+
+  test_layout(FRACTAL_MODE_RASTER, -0.75, 0.1, 0.2);
+  test_layout(FRACTAL_MODE_MARIANI_SILVER, -0.75, 0.1, 0.2);
+
+  test_simd(FRACTAL_MODE_RASTER, -1.0, 0.0, 3.2);
+  test_simd(FRACTAL_MODE_RASTER, -0.75, 0.1, 0.2);
+  test_simd(FRACTAL_MODE_RASTER, -1.0023, -0.3043, 0.0005);
+  test_simd(FRACTAL_MODE_PROGRESSIVE, -1.01, -0.3125, 0.01);
+
+  for (int derivative = 0; derivative < 2; ++derivative) {
+    test_interior_check(derivative, -1.0, 0.0, 3.2);
+    test_interior_check(derivative, -1.01, -0.3125, 0.01);
+    test_interior_check(derivative, -0.1, 0.9, 0.1);
+  }
+
+  test_perturbation(0.0, 1.0, 12, false);
+  test_perturbation(-0.10109636384562, 0.95628651080914, 12, false);
+  test_perturbation(-0.77568377, 0.13646737, 12, false);
+  test_perturbation(-1.25066, 0.02012, 7, true);
+
+  test_precision(-0.7436, 0.1318);
+  test_precision(-0.10109, 0.95628);
+
+  test_formula(FRACTAL_FORMULA_MANDELBROT, FRACTAL_PRECISION_Q6_26, -0.75, 0.1, 0.2);
+  test_formula(FRACTAL_FORMULA_JULIA, FRACTAL_PRECISION_Q6_26, 0.0, 0.0, 3.2);
+  test_formula(FRACTAL_FORMULA_JULIA, FRACTAL_PRECISION_Q4_28, 0.0, 0.446591, 0.001);
+  test_formula(FRACTAL_FORMULA_BURNING_SHIP, FRACTAL_PRECISION_Q6_26, -0.5, -0.5, 3.2);
+  test_formula(FRACTAL_FORMULA_BURNING_SHIP, FRACTAL_PRECISION_Q4_28, -0.4, -0.6, 3.5);
+  test_formula(FRACTAL_FORMULA_MULTIBROT3, FRACTAL_PRECISION_Q6_26, 0.0, 0.0, 3.0);
+  test_formula(FRACTAL_FORMULA_MULTIBROT3, FRACTAL_PRECISION_Q4_28, 0.190232, 0.760928, 0.001);
+
+  test_iter16(FRACTAL_MODE_RASTER, -1.0, 0.0, 3.2);
+  test_iter16(FRACTAL_MODE_MARIANI_SILVER, -0.75, 0.1, 0.2);
+  test_iteration_window(false, -0.743643887, 0.131825904, 0.0005);
+  test_iteration_window(true, -0.743643887, 0.131825904, 0.0005);
+
+  test_histogram(-0.75, 0.1, 0.2);
+  test_histogram(-0.743643887, 0.131825904, 0.0005);
+  test_equalise(-0.5, 0.0, 3.2);
+
+  test_smooth(-1.0, 0.0, 3.2);
+  test_smooth(-0.75, 0.1, 0.2);
+  test_smooth(-0.743643887, 0.131825904, 0.0005);
+
+  test_bilinear();
+  test_interp_columns(1, 3 << 20, 3 << 20, 0, 240);
+  test_interp_columns(2, 5 << 19, (3 << 22) / 2 + 12345, 10, 200);
+  test_interp_columns(1, (100 << 22) + 777, (1 << 22) / 7, 20, 240);
+  test_bilinear_layout(-0.75, 0.1, 0.2);
+
+  test_telemetry(-0.75, 0.1, 0.2);
+  test_input_trace();
+
+  test_cache(FRACTAL_MODE_RASTER, 8192, -0.75, 0.1, 0.2);
+  test_cache(FRACTAL_MODE_RASTER, 300, -0.75, 0.1, 0.2);
+  test_cache(FRACTAL_MODE_MARIANI_SILVER, 8192, -1.01, -0.3125, 0.01);
+
+  test_rle(FRACTAL_MODE_RASTER, 1, 2 * IMAGE_ROWS * IMAGE_COLS, -0.75, 0.1, 0.2);
+  test_rle(FRACTAL_MODE_MARIANI_SILVER, 2, 2 * IMAGE_ROWS * IMAGE_COLS, -1.0, 0.0, 3.2);
+  test_rle(FRACTAL_MODE_RASTER, 1, FRACTAL_RLE_MIN_SIZE(IMAGE_ROWS, IMAGE_COLS), -0.743643887, 0.131825904, 0.0005);
+  test_rle(FRACTAL_MODE_MARIANI_SILVER, 1, 2 * IMAGE_ROWS * IMAGE_COLS, -0.16, 1.04, 0.05);
+
+  test_progressive(-0.75, 0.1, 0.2);
+  test_progressive(-1.01, -0.3125, 0.01);
+
+  for (int threads = 2; threads <= FRACTAL_MAX_WORKERS; threads *= 2) {
+    test_workers(FRACTAL_MODE_RASTER, false, threads, -1.0, 0.0, 3.2);
+    test_workers(FRACTAL_MODE_MARIANI_SILVER, false, threads, -0.75, 0.1, 0.2);
+    test_workers(FRACTAL_MODE_RASTER, true, threads, 0.0, 1.0, 1e-9);
+    test_rle(FRACTAL_MODE_RASTER, threads, 2 * IMAGE_ROWS * IMAGE_COLS, -1.01, -0.3125, 0.01);
+    test_rle(FRACTAL_MODE_MARIANI_SILVER, threads, 2 * IMAGE_ROWS * IMAGE_COLS, -0.75, 0.1, 0.2);
+  }
+
+  if (failures) {
+    printf("%d checks failed\n", failures);
+    return 1;
+  }
+  printf("All tests passed\n");
+  return 0;
+}
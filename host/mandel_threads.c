@@ -0,0 +1,36 @@
+#include <pthread.h>
+#include "pico/stdlib.h"
+
+#include "mandelbrot.h"
+#include "mandel_threads.h"
+
+typedef struct {
+  FractalBuffer* f;
+  int worker;
+} WorkerArgs;
+
+static void* worker_entry(void* arg)
+{
+  WorkerArgs* args = arg;
+  generate_worker(args->f, args->worker);
+  return NULL;
+}
+
+void generate_fractal_threads(FractalBuffer* f, int num_threads)
+{
+  pthread_t threads[FRACTAL_MAX_WORKERS];
+  WorkerArgs args[FRACTAL_MAX_WORKERS];
+
+  num_threads = MAX(1, MIN(num_threads, FRACTAL_MAX_WORKERS));
+  for (int t = 1; t < num_threads; ++t) {
+    args[t].f = f;
+    args[t].worker = t;
+    pthread_create(&threads[t], NULL, worker_entry, &args[t]);
+  }
+
+  generate_worker(f, 0);
+
+  for (int t = 1; t < num_threads; ++t) {
+    pthread_join(threads[t], NULL);
+  }
+}
@@ -0,0 +1,12 @@
+// Host thread pool that generates a fractal buffer with several workers,
+// standing in for the two cores on the Pico.  Include after mandelbrot.h.
+
+#ifndef _MANDEL_THREADS_H
+#define _MANDEL_THREADS_H
+
+// Generate f, which must have been set up with init_fractal, on num_threads
+// threads including the calling one.  num_threads is clamped to
+// [1, FRACTAL_MAX_WORKERS].
+void generate_fractal_threads(FractalBuffer* f, int num_threads);
+
+#endif
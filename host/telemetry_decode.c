@@ -0,0 +1,109 @@
+// Decode the telemetry stream from the Pico's UART into CSV.
+//
+//   telemetry_decode [capture file] > telemetry.csv
+//
+// Reads stdin if no file is given.  Anything between frames, such as
+// printf output, is skipped, as are frames with a bad checksum.  Summary
+// statistics of each column go to stderr.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "mandelbrot.h"
+#include "telemetry.h"
+
+#define NUM_FIELDS 15
+
+static const char* field_names[NUM_FIELDS] = {
+  "sequence", "dropped", "generate_us", "display_us", "frames", "max_iter", "iter_offset",
+  "pixels_core0", "pixels_core1", "iterations", "cycle_iters_saved", "steal_idle", "dma_stall_us",
+  "clamps", "border_rows",
+};
+
+static void record_fields(const TelemetryRecord* r, uint32_t* v)
+{
+  v[0] = r->sequence;
+  v[1] = r->dropped;
+  v[2] = r->generate_us;
+  v[3] = r->display_us;
+  v[4] = r->frames;
+  v[5] = r->max_iter;
+  v[6] = r->iter_offset;
+  v[7] = r->pixels_core0;
+  v[8] = r->pixels_core1;
+  v[9] = r->iterations;
+  v[10] = r->cycle_iters_saved;
+  v[11] = r->steal_idle;
+  v[12] = r->dma_stall_us;
+  v[13] = r->clamps;
+  v[14] = r->border_rows;
+}
+
+int main(int argc, char** argv)
+{
+  FILE* in = stdin;
+  if (argc > 1) {
+    in = fopen(argv[1], "rb");
+    if (!in) {
+      perror(argv[1]);
+      return 1;
+    }
+  }
+
+  for (int k = 0; k < NUM_FIELDS; ++k) printf("%s%s", k ? "," : "", field_names[k]);
+  printf(",fps,ns_per_iter,clamps_per_s,border_rows_per_s\n");
+
+  uint32_t min[NUM_FIELDS], max[NUM_FIELDS];
+  double sum[NUM_FIELDS] = { 0 };
+  int records = 0;
+  uint32_t lost = 0;  // Sequence numbers missing from the stream
+  uint16_t next_sequence = 0;
+
+  uint8_t data[4096];
+  int len = 0;
+  size_t n;
+  while ((n = fread(data + len, 1, sizeof(data) - len, in)) > 0) {
+    len += n;
+    int pos = 0;
+    TelemetryRecord r;
+    int used;
+    while ((used = telemetry_decode(data + pos, len - pos, &r)) > 0) {
+      pos += used;
+
+      uint32_t v[NUM_FIELDS];
+      record_fields(&r, v);
+      for (int k = 0; k < NUM_FIELDS; ++k) {
+        if (!records || v[k] < min[k]) min[k] = v[k];
+        if (!records || v[k] > max[k]) max[k] = v[k];
+        sum[k] += v[k];
+        printf("%s%u", k ? "," : "", v[k]);
+      }
+      double fps = r.display_us ? r.frames * 1e6 / r.display_us : 0;
+      double ns_per_iter = r.iterations ? r.generate_us * 1e3 / r.iterations : 0;
+      double per_s = r.display_us ? 1e6 / r.display_us : 0;
+      printf(",%.1f,%.2f,%.1f,%.0f\n", fps, ns_per_iter, r.clamps * per_s, r.border_rows * per_s);
+
+      if (records) lost += (uint16_t)(r.sequence - next_sequence - r.dropped);
+      next_sequence = r.sequence + 1;
+      ++records;
+    }
+    if (len - pos >= TELEMETRY_FRAME_SIZE) pos = len - (TELEMETRY_FRAME_SIZE - 1);
+    memmove(data, data + pos, len - pos);
+    len -= pos;
+  }
+  if (in != stdin) fclose(in);
+
+  fprintf(stderr, "%d records, %u lost in transit\n", records, lost);
+  if (!records) return 0;
+  fprintf(stderr, "%-18s %12s %12s %12s\n", "field", "min", "mean", "max");
+  for (int k = 1; k < NUM_FIELDS; ++k) {
+    fprintf(stderr, "%-18s %12u %12.1f %12u\n", field_names[k], min[k], sum[k] / records, max[k]);
+  }
+  if (sum[3] > 0) {
+    fprintf(stderr, "%.1f clamps/s, %.0f border rows/s while displaying\n",
+            sum[13] * 1e6 / sum[3], sum[14] * 1e6 / sum[3]);
+  }
+  return 0;
+}
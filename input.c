@@ -0,0 +1,278 @@
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "mandelbrot.h"
+#include "telemetry.h"
+#include "input.h"
+
+#define INPUT_MAGIC0 0xa5
+#define INPUT_MAGIC1 0x5a
+
+// Events in the trace, each a tag byte and its fields.  Times are the
+// microseconds since the last timestamped event, as a varint.
+#define EVENT_SEED 0x01   // 32-bit seed
+#define EVENT_BUSY 0x02   // Core 1 hadn't finished
+#define EVENT_READY 0x03  // Core 1 had finished
+#define EVENT_VIEW 0x04   // Time, 32-bit hash of the viewport
+#define EVENT_POLL 0x10   // Flags below, time, then joyx and joyy if they changed
+#define POLL_ZBUTTON 0x01
+#define POLL_CBUTTON 0x02
+#define POLL_JOYSTICK 0x04
+#define POLL_FLAGS 0x07
+
+// Longest event, a poll with a 5 byte time
+#define EVENT_MAX 8
+
+__attribute__((weak)) uint32_t input_board_replay(const uint8_t** replay)
+{
+  (void)replay;
+  return 0;
+}
+
+__attribute__((weak)) void input_board_replay_ended(const InputTrace* t)
+{
+  (void)t;
+}
+
+void input_init(InputTrace* t, input_mode_t mode, void (*read)(InputState* s),
+                const uint8_t* replay, uint32_t replay_size)
+{
+  memset(t, 0, sizeof(*t));
+  t->mode = mode;
+  t->read = read;
+  t->replay = replay;
+  t->replay_size = replay_size;
+  t->last_us = time_us_64();
+}
+
+static uint8_t* put_varint(uint8_t* p, uint32_t v)
+{
+  while (v >= 0x80) {
+    *p++ = v | 0x80;
+    v >>= 7;
+  }
+  *p++ = v;
+  return p;
+}
+
+static uint8_t* put_time(InputTrace* t, uint8_t* p)
+{
+  uint64_t now = time_us_64();
+  uint32_t us = MIN(now - t->last_us, 0xffffffffu);
+  t->last_us = now;
+  t->trace_us += us;
+  return put_varint(p, us);
+}
+
+// Push an event to the ring whole, or stop recording if it won't fit
+static void record(InputTrace* t, const uint8_t* event, uint8_t* end)
+{
+  uint32_t len = end - event;
+  if (INPUT_RING_SIZE - (t->head - t->tail) < len) {
+    t->mode = INPUT_LIVE;
+    t->ready_end = t->head;
+    return;
+  }
+  for (uint32_t i = 0; i < len; ++i) t->ring[t->head++ % INPUT_RING_SIZE] = event[i];
+}
+
+static void end_replay(InputTrace* t)
+{
+  t->ended = true;
+  input_board_replay_ended(t);
+}
+
+// Replayed fields.  Running out of trace ends the replay.
+static uint32_t get_byte(InputTrace* t)
+{
+  if (t->replay_pos == t->replay_size) {
+    end_replay(t);
+    return 0;
+  }
+  return t->replay[t->replay_pos++];
+}
+
+static uint32_t get_varint(InputTrace* t)
+{
+  uint32_t v = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    uint32_t b = get_byte(t);
+    v |= (b & 0x7f) << shift;
+    if (!(b & 0x80)) break;
+  }
+  return v;
+}
+
+static uint32_t get32(InputTrace* t)
+{
+  uint32_t v = get_byte(t);
+  v |= get_byte(t) << 8;
+  v |= get_byte(t) << 16;
+  return v | (get_byte(t) << 24);
+}
+
+// Take the next event's tag if it's one of those expected.  Any other
+// event means the replay has gone a different way from the recording.
+static int get_tag(InputTrace* t, uint8_t expect, uint8_t mask)
+{
+  if (t->ended) return -1;
+  uint32_t tag = get_byte(t);
+  if (t->ended) return -1;
+  if ((tag & ~mask) != expect) {
+    t->mismatches++;
+    end_replay(t);
+    return -1;
+  }
+  return tag;
+}
+
+uint32_t input_seed(InputTrace* t, uint32_t seed)
+{
+  if (t->mode == INPUT_REPLAY) {
+    if (get_tag(t, EVENT_SEED, 0) >= 0) seed = get32(t);
+  } else if (t->mode == INPUT_RECORD) {
+    uint8_t event[EVENT_MAX] = { EVENT_SEED, seed, seed >> 8, seed >> 16, seed >> 24 };
+    record(t, event, event + 5);
+  }
+  return seed;
+}
+
+void input_poll(InputTrace* t, InputState* s)
+{
+  if (t->mode == INPUT_REPLAY) {
+    int tag = get_tag(t, EVENT_POLL, POLL_FLAGS);
+    if (tag >= 0) {
+      t->trace_us += get_varint(t);
+      if (tag & POLL_JOYSTICK) {
+        t->last.joyx = get_byte(t);
+        t->last.joyy = get_byte(t);
+      }
+      t->last.zbutton = tag & POLL_ZBUTTON;
+      t->last.cbutton = tag & POLL_CBUTTON;
+    }
+    *s = t->last;
+    return;
+  }
+
+  memset(s, 0, sizeof(*s));
+  if (t->read) t->read(s);
+  if (t->mode == INPUT_RECORD) {
+    uint8_t event[EVENT_MAX];
+    bool joystick = s->joyx != t->last.joyx || s->joyy != t->last.joyy;
+    event[0] = EVENT_POLL | (s->zbutton ? POLL_ZBUTTON : 0) | (s->cbutton ? POLL_CBUTTON : 0) |
+               (joystick ? POLL_JOYSTICK : 0);
+    uint8_t* p = put_time(t, event + 1);
+    if (joystick) {
+      *p++ = s->joyx;
+      *p++ = s->joyy;
+    }
+    record(t, event, p);
+  }
+  t->last = *s;
+}
+
+bool input_ready(InputTrace* t, bool ready)
+{
+  if (t->mode == INPUT_REPLAY) {
+    int tag = get_tag(t, EVENT_BUSY, EVENT_BUSY ^ EVENT_READY);
+    return tag >= 0 ? tag == EVENT_READY : ready;
+  }
+  if (t->mode == INPUT_RECORD) {
+    uint8_t event = ready ? EVENT_READY : EVENT_BUSY;
+    record(t, &event, &event + 1);
+  }
+  return ready;
+}
+
+// FNV-1a of the viewport and iteration window
+static uint32_t view_hash(const FractalBuffer* f)
+{
+  uint8_t view[4 * sizeof(double) + 4];
+  memcpy(view, &f->minx, sizeof(double));
+  memcpy(view + sizeof(double), &f->maxx, sizeof(double));
+  memcpy(view + 2 * sizeof(double), &f->miny, sizeof(double));
+  memcpy(view + 3 * sizeof(double), &f->maxy, sizeof(double));
+  uint8_t* p = view + 4 * sizeof(double);
+  p[0] = f->max_iter;
+  p[1] = f->max_iter >> 8;
+  p[2] = f->iter_offset;
+  p[3] = f->iter_offset >> 8;
+
+  uint32_t hash = 2166136261u;
+  for (uint32_t i = 0; i < sizeof(view); ++i) hash = (hash ^ view[i]) * 16777619u;
+  return hash;
+}
+
+void input_check_view(InputTrace* t, const FractalBuffer* f)
+{
+  if (t->mode == INPUT_REPLAY) {
+    if (get_tag(t, EVENT_VIEW, 0) < 0) return;
+    t->trace_us += get_varint(t);
+    uint32_t hash = get32(t);
+    if (t->ended) return;
+    t->generations++;
+    if (hash != view_hash(f)) t->mismatches++;
+    return;
+  }
+
+  t->generations++;
+  if (t->mode == INPUT_RECORD) {
+    uint8_t event[EVENT_MAX + 4] = { EVENT_VIEW };
+    uint8_t* p = put_time(t, event + 1);
+    uint32_t hash = view_hash(f);
+    for (int i = 0; i < 4; ++i) *p++ = hash >> (8 * i);
+    record(t, event, p);
+    t->ready_end = t->head;
+  }
+}
+
+int input_read(InputTrace* t, uint8_t* frame)
+{
+  uint32_t len = t->head - t->tail;
+  if (len < INPUT_CHUNK_SIZE) {
+    len = t->ready_end - t->tail;
+    if (len == 0 || len > INPUT_CHUNK_SIZE) return 0;
+  } else {
+    len = INPUT_CHUNK_SIZE;
+  }
+
+  frame[0] = INPUT_MAGIC0;
+  frame[1] = INPUT_MAGIC1;
+  frame[2] = INPUT_TRACE_VERSION;
+  frame[3] = len + 1;
+  frame[4] = t->chunk_sequence++;
+  for (uint32_t i = 0; i < len; ++i) frame[5 + i] = t->ring[t->tail++ % INPUT_RING_SIZE];
+  uint16_t checksum = telemetry_checksum(frame + 2, len + 3);
+  frame[5 + len] = checksum;
+  frame[6 + len] = checksum >> 8;
+  return len + 7;
+}
+
+int input_extract(const uint8_t* data, int len, uint8_t* trace, int max)
+{
+  int n = 0;
+  bool started = false;
+  uint8_t sequence = 0;
+  for (int i = 0; i + 7 <= len; ++i) {
+    const uint8_t* frame = data + i;
+    int size = frame[3];
+    if (frame[0] != INPUT_MAGIC0 || frame[1] != INPUT_MAGIC1 || frame[2] != INPUT_TRACE_VERSION ||
+        size < 2 || size > INPUT_CHUNK_SIZE + 1 || i + size + 6 > len) continue;
+    uint16_t checksum = frame[size + 4] | (frame[size + 5] << 8);
+    if (checksum != telemetry_checksum(frame + 2, size + 2)) continue;
+
+    // A run starts from chunk 0, and ends at a gap or a restart
+    if (frame[4] != sequence) {
+      if (started) break;
+      continue;
+    }
+    started = true;
+    sequence++;
+    int copy = MIN(size - 1, max - n);
+    memcpy(trace + n, frame + 5, copy);
+    n += copy;
+    if (n == max) break;
+    i += size + 5;
+  }
+  return n;
+}
@@ -0,0 +1,92 @@
+// The inputs that decide the path of a zoom: the random seed, the Nunchuck
+// as read each frame, and whether core 1 had finished its buffer each time
+// core 0 checked, which decides how many frames are shown per generation.
+// These can be recorded to a trace sent over the UART with the telemetry,
+// and a captured trace replayed on the host to follow exactly the same
+// path of viewports, so that timings can be compared between builds.
+// Include after mandelbrot.h.
+
+// Frames are 0xa5 0x5a, version, payload length, the payload and a
+// Fletcher-16 checksum of version, length and payload, as for telemetry.
+// The version byte also tells them apart from telemetry frames.  The
+// payload is a chunk sequence number and then the next bytes of the trace.
+#define INPUT_TRACE_VERSION 0x81
+#define INPUT_CHUNK_SIZE 42
+#define INPUT_FRAME_MAX (INPUT_CHUNK_SIZE + 7)
+
+// Recorded bytes held until they are read out.  If it fills, recording
+// stops, and the trace up to then is still good.
+#define INPUT_RING_SIZE 512
+
+typedef enum {
+  INPUT_LIVE,    // Inputs are read and not recorded
+  INPUT_RECORD,  // Inputs are read and recorded
+  INPUT_REPLAY,  // Inputs come from a trace
+} input_mode_t;
+
+typedef struct {
+  int8_t joyx, joyy;
+  bool zbutton, cbutton;
+} InputState;
+
+typedef struct {
+  input_mode_t mode;
+  void (*read)(InputState* s);  // Reads the live inputs, or NULL for none
+
+  // Trace being replayed, and the bytes of it used
+  const uint8_t* replay;
+  uint32_t replay_size;
+  uint32_t replay_pos;
+
+  // Recorded bytes pushed, read out, and up to where they can be read,
+  // mod 2^32.  Bytes can be read at the end of each generation or once
+  // there is a full chunk.
+  uint8_t ring[INPUT_RING_SIZE];
+  uint32_t head, tail, ready_end;
+  uint8_t chunk_sequence;
+
+  uint64_t last_us;       // Live time of the last timestamped event
+  uint64_t trace_us;      // Time from the start of the trace to it, as recorded
+  InputState last;        // Last state polled, as joystick moves are only recorded
+  uint32_t generations;   // Viewports checked
+  uint32_t mismatches;    // Replayed viewports different from those recorded
+  bool ended;             // Replay ran out of trace, or off the recorded path
+} InputTrace;
+
+// Start t in mode, replaying replay_size bytes of events from replay
+void input_init(InputTrace* t, input_mode_t mode, void (*read)(InputState* s),
+                const uint8_t* replay, uint32_t replay_size);
+
+// Board hooks, which have defaults that do nothing for the Pico.  The
+// host model replays a trace given on its command line, and exits at the
+// end of the replay with the result.
+//
+// Returns the length of a trace to replay in place of the live inputs,
+// setting *replay to it, or 0 for none
+uint32_t input_board_replay(const uint8_t** replay);
+// Called once a replay runs out of trace or goes off the recorded path
+void input_board_replay_ended(const InputTrace* t);
+
+// Returns the seed to use, which is the live seed unless replaying
+uint32_t input_seed(InputTrace* t, uint32_t seed);
+
+// Read the inputs for a frame into s
+void input_poll(InputTrace* t, InputState* s);
+
+// Returns whether core 1 has finished generating, which is ready unless
+// replaying.  A replayed true must be followed by waiting for core 1.
+bool input_ready(InputTrace* t, bool ready);
+
+// Record the viewport and iteration window of each generation, or when
+// replaying count it as a mismatch if it differs from the one recorded
+void input_check_view(InputTrace* t, const FractalBuffer* f);
+
+// Frame the next recorded bytes that can be read out into frame, which
+// must hold INPUT_FRAME_MAX bytes, returning the length of the frame or 0
+// if there is nothing to send.  Doesn't block.
+int input_read(InputTrace* t, uint8_t* frame);
+
+// Copy the trace carried by the input frames in a captured stream to
+// trace, returning its length.  It starts at the first chunk of a run, and
+// stops at the first chunk missing or corrupted, or once max bytes are copied.
+int input_extract(const uint8_t* data, int len, uint8_t* trace, int max);
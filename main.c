@@ -1,15 +1,23 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
 #include "pico/stdlib.h"
 #include "pico/multicore.h"
 #include "hardware/pio.h"
 #include "hardware/interp.h"
 #include "hardware/dma.h"
 #include "hardware/clocks.h"
+#include "hardware/uart.h"
 #include "hardware/regs/rosc.h"
 #include "hardware/regs/addressmap.h"
 
 #include "mandelbrot.h"
+#include "scaler.h"
+#include "telemetry.h"
+#include "input.h"
+#include "display.h"
 #include "st7789_lcd.h"
 
 //#define USE_NUNCHUCK
@@ -17,43 +25,352 @@
 #include "nunchuck.h"
 #endif
 
+// Zoom by this whole factor per generation instead of continuously, with
+// the grid snapped so that the samples that coincide with the previous
+// generation are copied rather than recomputed.
+//#define REUSE_ZOOM 2
+
+// Store iteration counts in 16 bits, so the window of iterations shown
+// isn't limited to 256.  The image is made smaller to fit SRAM.
+//#define ITER16
+
+// Colour by smoothed escape counts, blending between palette entries by
+// the fraction of each count, to hide the banding.  The fractions need
+// another byte per pixel, so the image is made smaller to fit SRAM.
+//#define SMOOTH
+
+// Keep 8x8 tiles of generated buffers in an LRU cache, keyed by position on
+// a grid of power-of-two pixel steps, so that panning back or zooming over
+// a region again takes them from the cache instead of iterating.  Views
+// are snapped to the grid.  The arena needs SRAM, so the image is made
+// smaller.
+//#define TILE_CACHE
+
+#if defined(TILE_CACHE) && (defined(REUSE_ZOOM) || defined(SMOOTH) || defined(ITER16))
+#error "TILE_CACHE replaces REUSE_ZOOM, and can't be used with SMOOTH or ITER16"
+#endif
+
+// Store the iteration buffers run-length encoded, so that a 480x480 image
+// fits where two 340x340 ones did, and the display can zoom further into
+// each buffer before reaching its edges.  Generation goes in bands through
+// a small ring shared by both buffers, and the display decodes the rows it
+// samples.  Rows that don't fit are stored at reduced horizontal resolution.
+//#define RLE_BUFFER
+
+#ifdef RLE_BUFFER
+#define IMAGE_ROWS 480
+#define IMAGE_COLS 480
+#elif defined(ITER16) || defined(SMOOTH) || defined(TILE_CACHE)
+#define IMAGE_ROWS 240
+#define IMAGE_COLS 240
+#else
 #define IMAGE_ROWS 340
 #define IMAGE_COLS 340
+#endif
+
+#ifdef ITER16
+typedef uint16_t image_pixel_t;
+#else
+typedef uint8_t image_pixel_t;
+#endif
+
+// Scale the buffer to the display by blending the four samples around each
+// display pixel instead of taking the nearest.  The display can then zoom
+// further into each generated buffer before blockiness shows, so each
+// generation covers a bigger zoom step.
+//#define BILINEAR
+
+#ifdef BILINEAR
+#define GENERATION_ZOOM 0.6
+#else
+#define GENERATION_ZOOM 0.85
+#endif
+
+// Palette entries per escape count, which SMOOTH and BILINEAR blend between
+#if defined(SMOOTH) || defined(BILINEAR)
+#define SMOOTH_BITS 2
+#else
+#define SMOOTH_BITS 0
+#endif
 
 #define DISPLAY_ROWS 240
 #define DISPLAY_COLS 240
 
-#define ZOOM_CENTRE_X -1.01f
-#define ZOOM_CENTRE_Y -0.3125f
-//#define ZOOM_CENTRE_X -1.0023f
-//#define ZOOM_CENTRE_Y -0.3043f
+// Formula to zoom into instead of the Mandelbrot set, with c for the
+// Julia set.  These start from a view centred on the origin.  Perturbation
+// and the tile cache are only for the Mandelbrot set, so deep zooms stop at
+// the limit of the Q4.28 kernel.
+//#define FORMULA FRACTAL_FORMULA_JULIA
+#define JULIA_CX -0.8
+#define JULIA_CY 0.156
+
+#ifdef FORMULA
+#define START_CENTRE_X 0.0
+#else
+#define FORMULA FRACTAL_FORMULA_MANDELBROT
+#define START_CENTRE_X -1.0
+#endif
+
+#define ZOOM_CENTRE_X -1.01
+#define ZOOM_CENTRE_Y -0.3125
+//#define ZOOM_CENTRE_X -1.0023
+//#define ZOOM_CENTRE_Y -0.3043
+
+// Zoom of the display each frame
+#define FRAME_ZOOM 0.9955
+
+// With the Nunchuck, centre each buffer where the view is predicted to be
+// by the time it's ready, from the recent joystick and the frames recent
+// generations took, and extend it in the direction the view is moving.
+// Comment out to centre buffers on the view as it is.
+#define PAN_PREDICTION
+
+// Furthest the view is predicted to pan in a generation, and so the most a
+// buffer is extended, as a fraction of the view
+#define PAN_MAX_LEAD 0.5
+
+// Below this height the Q6.26 kernel runs out of precision and generation
+// switches to perturbation, which is cheaper than Q4.60.
+#define PERTURBATION_SIZE 0.0003
 
 #define ITERATION_FIXED_PT 22
 
-uint8_t fractal_iter_buff[2][IMAGE_ROWS*IMAGE_COLS];
+// Generate in interlaced passes, coarse to fine, so that the display can
+// fill edges from the buffer being generated sooner
+//#define PROGRESSIVE
+
+#ifdef PROGRESSIVE
+#define IMAGE_MODE FRACTAL_MODE_PROGRESSIVE
+#else
+#define IMAGE_MODE FRACTAL_MODE_MARIANI_SILVER
+#endif
+
+// Fixed point for positions in the buffer being generated, which can be
+// further outside the display than ITERATION_FIXED_PT allows
+#define EDGE_FIXED_PT 16
+
+// Store the iteration buffers in 8x8 tiles instead of row major.  Pixels
+// that are close in the image are then close in memory, at the cost of
+// a software address calculation in the display sampler.
+//#define TILED_BUFFER
+
+#if defined(RLE_BUFFER) && (defined(ITER16) || defined(SMOOTH) || defined(TILED_BUFFER) || \
+                            defined(PROGRESSIVE) || defined(REUSE_ZOOM) || defined(TILE_CACHE))
+#error "RLE_BUFFER only encodes 8-bit row major buffers generated with Mariani-Silver"
+#endif
+
+#ifdef TILED_BUFFER
+#define IMAGE_LAYOUT FRACTAL_LAYOUT_TILED
+#define IMAGE_BUFFER_SIZE FRACTAL_TILED_BUFFER_SIZE(IMAGE_ROWS, IMAGE_COLS)
+#elif defined(RLE_BUFFER)
+#define IMAGE_LAYOUT FRACTAL_LAYOUT_RLE
+#define IMAGE_BUFFER_SIZE FRACTAL_RLE_RING_SIZE(IMAGE_COLS)
+#else
+#define IMAGE_LAYOUT FRACTAL_LAYOUT_ROW_MAJOR
+#define IMAGE_BUFFER_SIZE (IMAGE_ROWS*IMAGE_COLS)
+#endif
+
+// Encoded buffers share one ring to generate in
+#ifdef RLE_BUFFER
+#define ITER_BUFFERS 1
+#else
+#define ITER_BUFFERS 2
+#endif
+
+image_pixel_t fractal_iter_buff[ITER_BUFFERS][IMAGE_BUFFER_SIZE];
+#ifdef SMOOTH
+uint8_t fractal_smooth_buff[2][IMAGE_BUFFER_SIZE];
+#define SMOOTH_BUFF_BYTES sizeof(fractal_smooth_buff)
+#else
+#define SMOOTH_BUFF_BYTES 0
+#endif
+#ifdef TILE_CACHE
+#define CACHE_TILES 1280
+#define CACHE_BUCKETS 1024
+FractalCacheTile cache_tiles[CACHE_TILES];
+uint16_t cache_buckets[CACHE_BUCKETS];
+FractalCache tile_cache;
+#define CACHE_BYTES (sizeof(cache_tiles) + sizeof(cache_buckets))
+#else
+#define CACHE_BYTES 0
+#endif
+#ifdef RLE_BUFFER
+#define RLE_BUFF_SIZE (100 * 1024)
+_Static_assert(RLE_BUFF_SIZE >= FRACTAL_RLE_MIN_SIZE(IMAGE_ROWS, IMAGE_COLS), "Encoded rows may not fit");
+uint8_t fractal_rle_data[2][RLE_BUFF_SIZE];
+uint32_t fractal_rle_rows[2][IMAGE_ROWS];
+
+// Rows of the buffer being displayed, decoded as they're needed.  Row i
+// goes in slot i & 3, so the rows around a pixel can be decoded together.
+#define DECODED_ROWS 4
+uint8_t decoded_rows[DECODED_ROWS][IMAGE_COLS];
+const FractalBuffer* decoded_buffer[DECODED_ROWS];
+int16_t decoded_row_index[DECODED_ROWS];
+#ifdef BILINEAR
+uint8_t bilinear_rows[2][IMAGE_COLS];
+FractalBuffer bilinear_view;
+#endif
+#define RLE_BUFF_BYTES (sizeof(fractal_rle_data) + sizeof(fractal_rle_rows) + sizeof(decoded_rows))
+#else
+#define RLE_BUFF_BYTES 0
+#endif
 FractalBuffer fractal1, fractal2;
 
-uint16_t pixel_row_buff[2][DISPLAY_COLS];
+// Word aligned for packed display transfers
+_Static_assert(DISPLAY_COLS % ST7789_PIXELS_PER_WORD == 0, "Display rows must be whole DMA words");
+uint16_t pixel_row_buff[2][DISPLAY_COLS] __attribute__((aligned(4)));
+
+// Tiled rows aren't contiguous, so instead of the interpolator the display
+// samples each row at the buffer columns mapped once per frame
+#if !defined(BILINEAR) && defined(TILED_BUFFER)
+#define COLUMN_MAP
+uint16_t column_map[DISPLAY_COLS];
+#endif
 
+// max_iter starts at MAX_ITER for each zoom, then follows the escape
+// histogram of the previous generation within these limits
 #define MAX_ITER 0xe0
+#define MIN_ITER_LIMIT 0x40
+#define MAX_ITER_LIMIT 0x200
+
+pert_float_t ref_orbit[2][2*MAX_ITER_LIMIT];
+
+// Colours cycle through PALETTE_SIZE - 1 entries by escape iteration, with
+// entry 0 for inside the set.  Each buffer has a palette for the values it
+// stores, which are offset by its iter_offset.
+#define PALETTE_SIZE 0xe0
+#ifdef ITER16
+#define FRAME_PALETTE_SIZE MAX_ITER_LIMIT
+#else
+#define FRAME_PALETTE_SIZE 256
+#endif
+
+uint16_t frame_palette[2][FRAME_PALETTE_SIZE << SMOOTH_BITS];
+
+// A FractalBuffer as built for the Pico's two cores.  The host builds
+// them with room for more workers.
+#define FRACTAL_BUFFER_BYTES (sizeof(FractalBuffer) - (FRACTAL_MAX_WORKERS - 2) * sizeof(FractalWorker))
+
+// The reference orbits as built for the Pico, whose deltas are floats
+#define REF_ORBIT_BYTES (sizeof(ref_orbit) / sizeof(pert_float_t) * sizeof(float))
+
+// Leave 16KB of the 264KB of SRAM for the stacks, display rows and
+// everything else
+#define ITER_BUFF_BUDGET (248 * 1024)
+_Static_assert(sizeof(fractal_iter_buff) + SMOOTH_BUFF_BYTES + CACHE_BYTES + RLE_BUFF_BYTES +
+               REF_ORBIT_BYTES + sizeof(frame_palette) + 2 * FRACTAL_BUFFER_BYTES <= ITER_BUFF_BUDGET,
+               "Generation buffers don't fit in SRAM");
+
+// Once a buffer is generated, spread the palette over the escape
+// iterations it actually has, using the histogram built by generation.
+// Comment out to keep colours fixed by escape iteration.
+#define EQUALISE_PALETTE
+
+// Send a binary telemetry record per generation over the UART instead of
+// printing timings, see host/telemetry_decode.c.
+#define TELEMETRY
+
+// Record the seed, the Nunchuck and when each generation was ready, and
+// send them with the telemetry, so that the run can be replayed on the host
+// by host/mandel_render.  Needs TELEMETRY.
+#define INPUT_TRACE
+
+#if defined(INPUT_TRACE) && !defined(TELEMETRY)
+#error INPUT_TRACE needs TELEMETRY
+#endif
+
+InputTrace input_trace;
 
 void core1_entry() {
   mandel_init();
 
   while (true) {
-    FractalBuffer* fractal = (void*)multicore_fifo_pop_blocking();
+    FractalBuffer* fractal = (void*)(uintptr_t)multicore_fifo_pop_blocking();
 
     absolute_time_t start_time = get_absolute_time();
     generate_fractal(fractal); 
     absolute_time_t stop_time = get_absolute_time();
-    printf("Generated in %lldus core 0 did %d pixels\n", absolute_time_diff_us(start_time, stop_time), fractal->cols * (fractal->rows - fractal->iend) + fractal->cols - fractal->jend);
+#ifdef TELEMETRY
+    multicore_fifo_push_blocking(absolute_time_diff_us(start_time, stop_time));
+#else
+    printf("Generated in %" PRId64 "us core 0 did %d pixels, %d cycles saved %d iterations\n", absolute_time_diff_us(start_time, stop_time),
+           (int)fractal->workers[1].pixels, (int)fractal->cycle_count, (int)fractal->cycle_iters_saved);
 
     multicore_fifo_push_blocking(1);
+#endif
+  }
+}
+
+#ifdef TELEMETRY
+// Send what the UART will take without waiting.  Telemetry records and
+// input trace chunks are taken a frame at a time so they don't interleave.
+static void flush_telemetry()
+{
+  static uint8_t frame[MAX(TELEMETRY_FRAME_SIZE, INPUT_FRAME_MAX)];
+  static int pos, len;
+  while (uart_is_writable(uart0)) {
+    if (pos == len) {
+      pos = 0;
+      len = telemetry_read(frame, TELEMETRY_FRAME_SIZE);
+      if (len == 0) len = input_read(&input_trace, frame);
+      if (len == 0) break;
+    }
+    uart_putc_raw(uart0, frame[pos++]);
   }
 }
+#endif
+
+#ifdef USE_NUNCHUCK
+static void read_nunchuck(InputState* s)
+{
+  s->joyx = nunchuck_joyx();
+  s->joyy = nunchuck_joyy();
+  s->zbutton = nunchuck_zbutton();
+  s->cbutton = nunchuck_cbutton();
+}
+#endif
+
+#ifdef USE_NUNCHUCK
+// Pan per frame for a joystick position, as a fraction of the view
+static double pan_step(int joy)
+{
+  return abs(joy) > 7 ? (joy >> 3) * 0.001 : 0.0;
+}
+
+#ifdef PAN_PREDICTION
+typedef struct {
+  double vx, vy;  // Pan per frame, smoothed over recent frames
+  double frames;  // Frames shown before a generation was ready, smoothed
+} PanPredictor;
+
+static void pan_update(PanPredictor* p, int joyx, int joyy)
+{
+  p->vx += 0.25 * (pan_step(joyx) - p->vx);
+  p->vy += 0.25 * (pan_step(joyy) - p->vy);
+}
+
+static void pan_generated(PanPredictor* p, int frames)
+{
+  p->frames += 0.5 * (frames - p->frames);
+}
+
+// How far a view of the given size is predicted to pan at v per frame
+// before the next buffer is shown, as it zooms in by FRAME_ZOOM each frame.
+// That's once core 1 is ready, and once the view has zoomed in to fit.
+static double pan_lead(const PanPredictor* p, double v, double size)
+{
+  double frames = MAX(p->frames, log(GENERATION_ZOOM) / log(FRAME_ZOOM));
+  double lead = v * size * (1.0 - pow(FRAME_ZOOM, frames)) / (1.0 - FRAME_ZOOM);
+  return MAX(-PAN_MAX_LEAD * size, MIN(lead, PAN_MAX_LEAD * size));
+}
+#endif
+#endif
 
-void seed_random_from_rosc()
+// Host builds take the seed the caller gave srand, so that renders can be
+// repeated
+uint32_t random_from_rosc()
 {
+#if PICO_ON_DEVICE
   uint32_t random = 0;
   uint32_t random_bit;
   volatile uint32_t *rnd_reg = (uint32_t *)(ROSC_BASE + ROSC_RANDOMBIT_OFFSET);
@@ -67,23 +384,84 @@ void seed_random_from_rosc()
     random = (random << 1) | random_bit;
   }
 
-  srand(random);
-} 
+  return random;
+#else
+  return rand();
+#endif
+}
+
+#ifdef RLE_BUFFER
+// Row i of a generated buffer
+static const uint8_t* image_row(const FractalBuffer* f, int i)
+{
+  int slot = i & (DECODED_ROWS - 1);
+  if (decoded_buffer[slot] != f || decoded_row_index[slot] != i) {
+    fractal_rle_row(f, i, decoded_rows[slot]);
+    decoded_buffer[slot] = f;
+    decoded_row_index[slot] = i;
+  }
+  return decoded_rows[slot];
+}
+
+// Drop decoded rows of f before it is generated again
+static void forget_decoded_rows(const FractalBuffer* f)
+{
+  for (int slot = 0; slot < DECODED_ROWS; ++slot) {
+    if (decoded_buffer[slot] == f) decoded_buffer[slot] = NULL;
+  }
+}
+#endif
+
+// Pixel (i, j) of a generated buffer, and its address
+static inline const image_pixel_t* image_pixel_ptr(const FractalBuffer* f, int i, int j)
+{
+#ifdef RLE_BUFFER
+  return image_row(f, i) + j;
+#else
+  return (const image_pixel_t*)f->buff + fractal_pixel_index(f, i, j);
+#endif
+}
+
+static inline uint16_t image_pixel(const FractalBuffer* f, int i, int j)
+{
+  return *image_pixel_ptr(f, i, j);
+}
+
+// Start of row i of a generated buffer, which column offsets from
+// image_col_offset are added to
+static inline const image_pixel_t* image_row_ptr(const FractalBuffer* f, int i)
+{
+#ifdef RLE_BUFFER
+  return image_row(f, i);
+#else
+  return (const image_pixel_t*)f->buff + fractal_pixel_index(f, i, 0);
+#endif
+}
 
-void choose_init_zoomc(FractalBuffer* f, float* zoomx, float* zoomy)
+static inline uint16_t image_col_offset(const FractalBuffer* f, int j)
+{
+#ifdef TILED_BUFFER
+  return fractal_pixel_index(f, 0, j);
+#else
+  (void)f;
+  return j;
+#endif
+}
+
+void choose_init_zoomc(FractalBuffer* f, double* zoomx, double* zoomy)
 {
   // Choose a random location that has exactly 1 neighbour inside the set
   int chosen_i, chosen_j;
   int choices = 0;
   for (int i = 1; i < IMAGE_ROWS-1; ++i) {
     for (int j = 1; j < IMAGE_COLS-1; ++j) {
-      if (f->buff[i * IMAGE_COLS + j] == 0) continue;
+      if (image_pixel(f, i, j) == 0) continue;
       
       int count = 0;
-      if (f->buff[(i-1) * IMAGE_COLS + j] == 0) count++;
-      if (f->buff[(i+1) * IMAGE_COLS + j] == 0) count++;
-      if (f->buff[i * IMAGE_COLS + j-1] == 0) count++;
-      if (f->buff[i * IMAGE_COLS + j+1] == 0) count++;
+      if (image_pixel(f, i-1, j) == 0) count++;
+      if (image_pixel(f, i+1, j) == 0) count++;
+      if (image_pixel(f, i, j-1) == 0) count++;
+      if (image_pixel(f, i, j+1) == 0) count++;
       
       if (count == 1) {
         if (rand() % ++choices == 0) {
@@ -98,7 +476,15 @@ void choose_init_zoomc(FractalBuffer* f, float* zoomx, float* zoomy)
   *zoomy = f->miny + chosen_i * (f->maxy - f->miny) / IMAGE_ROWS;
 }
 
-void refine_zoomc(FractalBuffer* f, float* zoomx, float* zoomy)
+// Palette entry for pixel (i, j) of f
+static inline uint16_t palette_index(const FractalBuffer* f, int i, int j)
+{
+  uint16_t k = image_pixel(f, i, j);
+  if (k == 0) return 0;
+  return (k + f->iter_offset - 1) % (PALETTE_SIZE - 1) + 1;
+}
+
+void refine_zoomc(FractalBuffer* f, double* zoomx, double* zoomy)
 {
   // Choose a centre that has a boundary between green and red pixels
   // i.e. iteration number between 0x5f and 0x60
@@ -120,12 +506,12 @@ void refine_zoomc(FractalBuffer* f, float* zoomx, float* zoomy)
       steps_to_do = steps;
     }
 
-    if ((f->buff[i * IMAGE_COLS + j] & 0x7e) != 0x4e) continue;
+    if ((palette_index(f, i, j) & 0x7e) != 0x4e) continue;
 
-    if (f->buff[(i-1) * IMAGE_COLS + j] >= 0x54 ||
-        f->buff[(i+1) * IMAGE_COLS + j] >= 0x54 ||
-        f->buff[i * IMAGE_COLS + j-1] >= 0x54 ||
-        f->buff[i * IMAGE_COLS + j+1] >= 0x54) {
+    if (palette_index(f, i-1, j) >= 0x54 ||
+        palette_index(f, i+1, j) >= 0x54 ||
+        palette_index(f, i, j-1) >= 0x54 ||
+        palette_index(f, i, j+1) >= 0x54) {
       *zoomx = f->minx + j * (f->maxx - f->minx) / IMAGE_COLS;
       *zoomy = f->miny + i * (f->maxy - f->miny) / IMAGE_ROWS;
       return;
@@ -135,22 +521,152 @@ void refine_zoomc(FractalBuffer* f, float* zoomx, float* zoomy)
   // Don't change the zoom if the criteria weren't met
 }
 
+// Set the frame palette entries for value k, blending from colour towards
+// next_colour by the fraction of the count.  Entries are in the order the
+// display DMA sends them.
+static void set_frame_colours(uint16_t* frame_palette, int k, uint16_t colour, uint16_t next_colour)
+{
+  for (int t = 0; t < (1 << SMOOTH_BITS); ++t) {
+    int s = (1 << SMOOTH_BITS) - t;
+    uint16_t r = ((colour >> 11) * s + (next_colour >> 11) * t) >> SMOOTH_BITS;
+    uint16_t g = (((colour >> 5) & 0x3f) * s + ((next_colour >> 5) & 0x3f) * t) >> SMOOTH_BITS;
+    uint16_t b = ((colour & 0x1f) * s + (next_colour & 0x1f) * t) >> SMOOTH_BITS;
+    frame_palette[(k << SMOOTH_BITS) + t] = st7789_pixel((r << 11) | (g << 5) | b);
+  }
+}
+
+static void fill_frame_palette(const FractalBuffer* f, const uint16_t* palette, uint16_t* frame_palette)
+{
+  set_frame_colours(frame_palette, 0, palette[0], palette[0]);
+  for (int k = 1; k < FRAME_PALETTE_SIZE; ++k) {
+    set_frame_colours(frame_palette, k, palette[(k + f->iter_offset - 1) % (PALETTE_SIZE - 1) + 1],
+                      palette[(k + f->iter_offset) % (PALETTE_SIZE - 1) + 1]);
+  }
+}
+
+#ifdef EQUALISE_PALETTE
+// Histogram equalised palette for a generated buffer: each bin gets the
+// entry at the middle of its share of the escaped pixels
+static void equalise_frame_palette(const FractalBuffer* f, const uint16_t* palette, uint16_t* frame_palette)
+{
+  uint16_t bin_colour[FRACTAL_HISTOGRAM_BINS];
+  if (!fractal_equalise_histogram(f, PALETTE_SIZE - 1, bin_colour)) return;
+  for (int b = 0; b < FRACTAL_HISTOGRAM_BINS; ++b) bin_colour[b] = palette[bin_colour[b]];
+
+  set_frame_colours(frame_palette, 0, palette[0], palette[0]);
+  for (int k = 1; k < FRAME_PALETTE_SIZE; ++k) {
+    set_frame_colours(frame_palette, k, bin_colour[MIN(k >> f->histogram_shift, FRACTAL_HISTOGRAM_BINS - 1)],
+                      bin_colour[MIN((k + 1) >> f->histogram_shift, FRACTAL_HISTOGRAM_BINS - 1)]);
+  }
+}
+#endif
+
+// Colour for a display pixel outside the buffer being displayed, taken
+// from the passes completed so far of the buffer being generated.
+// (y, x) is the position in f in EDGE_FIXED_PT fixed point.
+static inline uint16_t edge_pixel(const FractalBuffer* f, const uint16_t* palette, uint8_t passes, int32_t y, int32_t x)
+{
+  if (passes == 0 || y < 0 || x < 0) return 0;
+  int i = y >> EDGE_FIXED_PT;
+  int j = x >> EDGE_FIXED_PT;
+  if (i >= IMAGE_ROWS || j >= IMAGE_COLS) return 0;
+  return palette[fractal_progressive_pixel(f, passes, i, j) << SMOOTH_BITS];
+}
+
+// Colour for the pixel at iter in the buffer being displayed
+static inline uint16_t buffer_pixel(const FractalBuffer* f, const uint16_t* palette, const image_pixel_t* iter)
+{
+#ifdef SMOOTH
+  const uint8_t* smooth = f->smooth + (iter - (const image_pixel_t*)f->buff);
+  return palette[(*iter << SMOOTH_BITS) | (*smooth >> (8 - SMOOTH_BITS))];
+#else
+  (void)f;
+  return palette[*iter];
+#endif
+}
+
+#if !defined(BILINEAR) && !defined(TILED_BUFFER)
+// Whether columns j0 to j1 of a buffer row all have the same colour
+static bool row_uniform(const FractalBuffer* f, const image_pixel_t* row, int j0, int j1)
+{
+  for (int j = j0 + 1; j <= j1; ++j) {
+    if (row[j] != row[j0]) return false;
+  }
+#ifdef SMOOTH
+  const uint8_t* smooth = f->smooth + (row - (const image_pixel_t*)f->buff);
+  for (int j = j0 + 1; j <= j1; ++j) {
+    if ((smooth[j] ^ smooth[j0]) >> (8 - SMOOTH_BITS)) return false;
+  }
+#else
+  (void)f;
+#endif
+  return true;
+}
+#endif
+
 int main()
 {
     FractalBuffer* fractal_read;
     FractalBuffer* fractal_write;
-    fractal1.buff = fractal_iter_buff[0];
+    fractal1.buff = (uint8_t*)fractal_iter_buff[0];
+#ifdef ITER16
+    fractal1.iter16 = true;
+#endif
+#ifdef SMOOTH
+    fractal1.smooth = fractal_smooth_buff[0];
+#endif
     fractal1.rows = IMAGE_ROWS;
     fractal1.cols = IMAGE_COLS;
     fractal1.max_iter = MAX_ITER;
     fractal1.iter_offset = 0;
-    fractal1.use_cycle_check = false;
-    fractal2.buff = fractal_iter_buff[1];
+    fractal1.use_cycle_check = true;
+    fractal1.formula = FORMULA;
+    fractal1.julia_cx = JULIA_CX;
+    fractal1.julia_cy = JULIA_CY;
+    fractal1.precision = FRACTAL_PRECISION_AUTO;
+    fractal1.mode = IMAGE_MODE;
+    fractal1.layout = IMAGE_LAYOUT;
+    fractal1.use_perturbation = false;
+    fractal1.ref_orbit = ref_orbit[0];
+    fractal2.buff = (uint8_t*)fractal_iter_buff[ITER_BUFFERS - 1];
+#ifdef ITER16
+    fractal2.iter16 = true;
+#endif
+#ifdef SMOOTH
+    fractal2.smooth = fractal_smooth_buff[1];
+#endif
     fractal2.rows = IMAGE_ROWS;
     fractal2.cols = IMAGE_COLS;
     fractal2.max_iter = MAX_ITER;
     fractal2.iter_offset = 0;
-    fractal2.use_cycle_check = false;
+    fractal2.use_cycle_check = true;
+    fractal2.formula = FORMULA;
+    fractal2.julia_cx = JULIA_CX;
+    fractal2.julia_cy = JULIA_CY;
+    fractal2.precision = FRACTAL_PRECISION_AUTO;
+    fractal2.mode = IMAGE_MODE;
+    fractal2.layout = IMAGE_LAYOUT;
+    fractal2.use_perturbation = false;
+    fractal2.ref_orbit = ref_orbit[1];
+#ifdef RLE_BUFFER
+    fractal1.rle_data = fractal_rle_data[0];
+    fractal1.rle_size = RLE_BUFF_SIZE;
+    fractal1.rle_rows = fractal_rle_rows[0];
+    fractal2.rle_data = fractal_rle_data[1];
+    fractal2.rle_size = RLE_BUFF_SIZE;
+    fractal2.rle_rows = fractal_rle_rows[1];
+#ifdef BILINEAR
+    bilinear_view.buff = bilinear_rows[0];
+    bilinear_view.rows = 2;
+    bilinear_view.cols = IMAGE_COLS;
+    bilinear_view.layout = FRACTAL_LAYOUT_ROW_MAJOR;
+#endif
+#endif
+#ifdef TILE_CACHE
+    fractal_cache_init(&tile_cache, cache_tiles, CACHE_TILES, cache_buckets, CACHE_BUCKETS);
+    fractal1.cache = &tile_cache;
+    fractal2.cache = &tile_cache;
+#endif
 
     // Set clock speed to max in spec.
     // To overclock, you could try these settings:
@@ -171,27 +687,47 @@ int main()
     nunchuck_init(12, 13);
 #endif
 
-    seed_random_from_rosc();
+#ifdef USE_NUNCHUCK
+    void (*read_input)(InputState* s) = read_nunchuck;
+#else
+    void (*read_input)(InputState* s) = NULL;
+#endif
+    const uint8_t* replay;
+    uint32_t replay_size = input_board_replay(&replay);
+    if (replay_size) {
+      input_init(&input_trace, INPUT_REPLAY, read_input, replay, replay_size);
+    } else {
+#ifdef INPUT_TRACE
+      input_init(&input_trace, INPUT_RECORD, read_input, NULL, 0);
+#else
+      input_init(&input_trace, INPUT_LIVE, read_input, NULL, 0);
+#endif
+    }
+    srand(input_seed(&input_trace, random_from_rosc()));
 
-    PIO pio = pio0;
-    uint sm = 0;
-    st7789_init(pio, sm);
-    uint st7789_chan[2];
-    st7789_create_dma_channels(pio, sm, st7789_chan);
+    DisplayBackend display;
+    St7789Display lcd;
+    st7789_display_init(&display, &lcd, pio0, 0);
 
     multicore_launch_core1(core1_entry);
 
+#ifdef BILINEAR
+    scale_init();
+#else
     interp_config cfg = interp_default_config();
     interp_config_set_add_raw(&cfg, true);
-    interp_config_set_shift(&cfg, ITERATION_FIXED_PT);
-    interp_config_set_mask(&cfg, 0, 31 - ITERATION_FIXED_PT);
+    // Lane 0 gives the byte offset of the pixel in the row
+    const uint pixel_shift = sizeof(image_pixel_t) - 1;
+    interp_config_set_shift(&cfg, ITERATION_FIXED_PT - pixel_shift);
+    interp_config_set_mask(&cfg, pixel_shift, 31 - ITERATION_FIXED_PT + pixel_shift);
     interp_config_set_signed(&cfg, true);
     interp_set_config(interp0, 0, &cfg);
     interp0->base[1] = 0;
     interp0->accum[1] = 0;
+#endif
 
-    uint16_t palette[MAX_ITER];
-    for (int i = 0; i < MAX_ITER; ++i) {
+    uint16_t palette[PALETTE_SIZE];
+    for (int i = 0; i < PALETTE_SIZE; ++i) {
       //palette[i] = ((i & 7) << 2) | ((i & 0x18) << 5) | ((i & 0xe0) << 8);
       //
       //if (i < 0x40)
@@ -206,28 +742,52 @@ int main()
     }
 
 #ifdef USE_NUNCHUCK
-    float zoomx = ZOOM_CENTRE_X;
-    float zoomy = ZOOM_CENTRE_Y;
+    double zoomx = ZOOM_CENTRE_X;
+    double zoomy = ZOOM_CENTRE_Y;
 #else
-    float zoomx = -1.f;
-    float zoomy = 0.f;
+    double zoomx = START_CENTRE_X;
+    double zoomy = 0.0;
+#endif
+    const double zoomr = GENERATION_ZOOM * 0.5;
+#if defined(USE_NUNCHUCK) && defined(PAN_PREDICTION)
+    PanPredictor pan = { 0 };
 #endif
-    const float zoomr = 0.85f * 0.5f;
     while (1) {
-      fractal1.minx = zoomx - 1.75f;
-      fractal1.maxx = zoomx + 1.75f;
-      fractal1.miny = zoomy - 1.6f;
-      fractal1.maxy = zoomy + 1.6f;
-      float minx = fractal1.minx;
-      float maxx = fractal1.maxx;
-      float sizex = maxx - minx;
-      float miny = fractal1.miny;
-      float maxy = fractal1.maxy;
-      float sizey = maxy - miny;
+      fractal1.minx = zoomx - 1.75;
+      fractal1.maxx = zoomx + 1.75;
+      fractal1.miny = zoomy - 1.6;
+      fractal1.maxy = zoomy + 1.6;
+#ifdef REUSE_ZOOM
+      snap_fractal_viewport(&fractal1, NULL, REUSE_ZOOM);
+#endif
+#ifdef TILE_CACHE
+      fractal_cache_snap_viewport(&fractal1);
+#endif
+      fractal1.reuse_from = NULL;
+      double minx = fractal1.minx;
+      double maxx = fractal1.maxx;
+      double sizex = maxx - minx;
+      double miny = fractal1.miny;
+      double maxy = fractal1.maxy;
+      double sizey = maxy - miny;
       fractal1.use_cycle_check = true;
+      fractal1.use_perturbation = false;
+      fractal1.max_iter = MAX_ITER;
+      fractal1.iter_offset = 0;
+#ifdef RLE_BUFFER
+      forget_decoded_rows(&fractal1);
+#endif
       init_fractal(&fractal1);
-      multicore_fifo_push_blocking((uint32_t)&fractal1);
+      input_check_view(&input_trace, &fractal1);
+      fill_frame_palette(&fractal1, palette, frame_palette[0]);
+      multicore_fifo_push_blocking((uint32_t)(uintptr_t)&fractal1);
       multicore_fifo_pop_blocking();
+#ifdef TILE_CACHE
+      fractal_cache_store(&fractal1);
+#endif
+#ifdef EQUALISE_PALETTE
+      equalise_frame_palette(&fractal1, palette, frame_palette[0]);
+#endif
       
 #ifndef USE_NUNCHUCK
       choose_init_zoomc(&fractal1, &zoomx, &zoomy);
@@ -236,48 +796,100 @@ int main()
       fractal2.count_inside = IMAGE_ROWS*IMAGE_COLS;
       fractal_read = &fractal1;
       fractal_write = &fractal2;
+      uint16_t* read_palette = frame_palette[0];
+      uint16_t* write_palette = frame_palette[1];
       bool reset = false;
       bool lastzoom = false;
 
       while (!reset) {
-#ifdef USE_NUNCHUCK
-        lastzoom |= sizey < 0.0002f;
-#else
-        lastzoom |= sizey < 0.0003f;
-#endif
-        float next_zoomx = zoomx;
-        float next_zoomy = zoomy;
+        lastzoom |= sizey < 1e-12;
+        double next_zoomx = zoomx;
+        double next_zoomy = zoomy;
         if (!lastzoom) {
 #ifndef USE_NUNCHUCK
           refine_zoomc(fractal_read, &next_zoomx, &next_zoomy);
+#elif defined(PAN_PREDICTION)
+          next_zoomx += pan_lead(&pan, pan.vx, sizex);
+          next_zoomy += pan_lead(&pan, pan.vy, sizey);
 #endif
+#ifdef REUSE_ZOOM
+          double read_sizex = fractal_read->maxx - fractal_read->minx;
+          double read_sizey = fractal_read->maxy - fractal_read->miny;
+          fractal_write->minx = next_zoomx - 0.5 * read_sizex / REUSE_ZOOM;
+          fractal_write->maxx = next_zoomx + 0.5 * read_sizex / REUSE_ZOOM;
+          fractal_write->miny = next_zoomy - 0.5 * read_sizey / REUSE_ZOOM;
+          fractal_write->maxy = next_zoomy + 0.5 * read_sizey / REUSE_ZOOM;
+          snap_fractal_viewport(fractal_write, fractal_read, REUSE_ZOOM);
+          fractal_write->reuse_from = fractal_read;
+#else
           fractal_write->minx = next_zoomx - zoomr * sizex;
           fractal_write->maxx = next_zoomx + zoomr * sizex;
           fractal_write->miny = next_zoomy - zoomr * sizey;
           fractal_write->maxy = next_zoomy + zoomr * sizey;
+          fractal_write->reuse_from = NULL;
+#if defined(USE_NUNCHUCK) && defined(PAN_PREDICTION) && !defined(TILE_CACHE)
+          // Cover where the view should pan to while the buffer is displayed.
+          // The cache's grid needs square pixels, so it only gets the lead.
+          double margin_x = pan_lead(&pan, pan.vx, sizex);
+          double margin_y = pan_lead(&pan, pan.vy, sizey);
+          if (margin_x > 0) fractal_write->maxx += margin_x;
+          else fractal_write->minx += margin_x;
+          if (margin_y > 0) fractal_write->maxy += margin_y;
+          else fractal_write->miny += margin_y;
+#endif
+#endif
+#ifdef TILE_CACHE
+          fractal_cache_snap_viewport(fractal_write);
+#endif
         } else {
           fractal_write->minx = minx;
           fractal_write->maxx = maxx;
           fractal_write->miny = miny;
           fractal_write->maxy = maxy;
+          fractal_write->reuse_from = NULL;
         }
-        fractal_write->use_cycle_check = sizey > 0.01f && 
-                    fractal_write->count_inside > (IMAGE_ROWS*IMAGE_COLS) / 16;
+        fractal_write->use_cycle_check = true;
+        fractal_write->use_perturbation = sizey < PERTURBATION_SIZE;
+        choose_iteration_window(fractal_write, fractal_read, MIN_ITER_LIMIT, MAX_ITER_LIMIT);
 
-        printf("Generating in (%f, %f) - (%f, %f) Zoom centre: (%f, %f)\n",
+#ifndef TELEMETRY
+        printf("Generating in (%f, %f) - (%f, %f) Zoom centre: (%f, %f) Iterations %d-%d\n",
               fractal_write->minx, fractal_write->miny,
               fractal_write->maxx, fractal_write->maxy,
-              zoomx, zoomy);
+              zoomx, zoomy, fractal_write->iter_offset, fractal_write->max_iter);
+#endif
 
+#ifdef RLE_BUFFER
+        forget_decoded_rows(fractal_write);
+#endif
         init_fractal(fractal_write);
-        multicore_fifo_push_blocking((uint32_t)fractal_write);
+        input_check_view(&input_trace, fractal_write);
+        fill_frame_palette(fractal_write, palette, write_palette);
+        multicore_fifo_push_blocking((uint32_t)(uintptr_t)fractal_write);
 
-        float zoomminx = zoomx - zoomr * (fractal_write->maxx - fractal_write->minx);
-        float zoommaxx = zoomx + zoomr * (fractal_write->maxx - fractal_write->minx);
-        float zoomminy = zoomy - zoomr * (fractal_write->maxy - fractal_write->miny);
-        float zoommaxy = zoomy + zoomr * (fractal_write->maxy - fractal_write->miny);
+#if defined(USE_NUNCHUCK) && defined(PAN_PREDICTION)
+        // The view can pan as near the edges of the buffer as it could
+        // unpredicted, and stays free to where it is now
+        double write_sizex = fractal_write->maxx - fractal_write->minx;
+        double write_sizey = fractal_write->maxy - fractal_write->miny;
+        double zoomminx = MIN(zoomx, fractal_write->minx + (0.5 - zoomr) * write_sizex);
+        double zoommaxx = MAX(zoomx, fractal_write->maxx - (0.5 - zoomr) * write_sizex);
+        double zoomminy = MIN(zoomy, fractal_write->miny + (0.5 - zoomr) * write_sizey);
+        double zoommaxy = MAX(zoomy, fractal_write->maxy - (0.5 - zoomr) * write_sizey);
+#else
+        double zoomminx = zoomx - zoomr * (fractal_write->maxx - fractal_write->minx);
+        double zoommaxx = zoomx + zoomr * (fractal_write->maxx - fractal_write->minx);
+        double zoomminy = zoomy - zoomr * (fractal_write->maxy - fractal_write->miny);
+        double zoommaxy = zoomy + zoomr * (fractal_write->maxy - fractal_write->miny);
+#endif
+
+        const double izoomr = FRAME_ZOOM * 0.5;
 
-        const float izoomr = 0.9955f * 0.5f;
+        // Frames where panning hit the edge, display rows not wholly
+        // inside the buffer displayed, and the frame core 1 was first ready
+        uint16_t clamps = 0;
+        uint32_t border_rows = 0;
+        int ready_frame = 0;
 
         int iz = 1;
         absolute_time_t start_time = get_absolute_time();
@@ -290,63 +902,171 @@ int main()
           if (maxx > fractal_read->maxx) jmax = (fractal_read->maxx - minx) * DISPLAY_COLS / (maxx - minx);
           if (miny < fractal_read->miny) imin = 1 + (fractal_read->miny - miny) * DISPLAY_ROWS / (maxy - miny);
           if (maxy > fractal_read->maxy) imax = (fractal_read->maxy - miny) * DISPLAY_ROWS / (maxy - miny);
+          // A view panned wholly off one side of the buffer takes no columns from it
+          jmin = MIN(jmin, DISPLAY_COLS);
+          jmax = MAX(jmax, jmin);
+          border_rows += jmin > 0 || jmax < DISPLAY_COLS ? DISPLAY_ROWS : DISPLAY_ROWS - MAX(imax - imin, 0);
 
-          int32_t y = (int32_t)(((miny - fractal_read->miny) / (fractal_read->maxy - fractal_read->miny)) * IMAGE_ROWS * (float)(1 << ITERATION_FIXED_PT));
-          int32_t y_step = (int32_t)((sizey / ((fractal_read->maxy - fractal_read->miny) * DISPLAY_ROWS)) * IMAGE_ROWS * (float)(1 << ITERATION_FIXED_PT));
-          int32_t x_start = (int32_t)(((minx - fractal_read->minx) / (fractal_read->maxx - fractal_read->minx)) * IMAGE_COLS * (float)(1 << ITERATION_FIXED_PT));
-          interp0->base[0] = (int32_t)((sizex / ((fractal_read->maxx - fractal_read->minx) * DISPLAY_COLS)) * IMAGE_COLS * (float)(1 << ITERATION_FIXED_PT));
+          int32_t y = (int32_t)(((miny - fractal_read->miny) / (fractal_read->maxy - fractal_read->miny)) * IMAGE_ROWS * (double)(1 << ITERATION_FIXED_PT));
+          int32_t y_step = (int32_t)((sizey / ((fractal_read->maxy - fractal_read->miny) * DISPLAY_ROWS)) * IMAGE_ROWS * (double)(1 << ITERATION_FIXED_PT));
+          int32_t x_start = (int32_t)(((minx - fractal_read->minx) / (fractal_read->maxx - fractal_read->minx)) * IMAGE_COLS * (double)(1 << ITERATION_FIXED_PT));
+          int32_t x_step = (int32_t)((sizex / ((fractal_read->maxx - fractal_read->minx) * DISPLAY_COLS)) * IMAGE_COLS * (double)(1 << ITERATION_FIXED_PT));
 
           // Offset x and y by half a step so that we get round to nearest
           y += y_step >> 1;
-          x_start += interp0->base[0] >> 1;
+          x_start += x_step >> 1;
+#if !defined(BILINEAR) && !defined(TILED_BUFFER)
+          interp0->base[0] = x_step;
+#endif
 
-          st7789_start_pixels(pio, sm);
-          for (int i = 0; i < DISPLAY_ROWS; ++i, y += y_step) {
+          // Position of the display in the buffer being generated, for edges
+          uint8_t edge_passes = fractal_write->passes_done;
+          int32_t edge_y = (int32_t)(((miny - fractal_write->miny) / (fractal_write->maxy - fractal_write->miny)) * IMAGE_ROWS * (double)(1 << EDGE_FIXED_PT));
+          int32_t edge_y_step = (int32_t)((sizey / ((fractal_write->maxy - fractal_write->miny) * DISPLAY_ROWS)) * IMAGE_ROWS * (double)(1 << EDGE_FIXED_PT));
+          int32_t edge_x_start = (int32_t)(((minx - fractal_write->minx) / (fractal_write->maxx - fractal_write->minx)) * IMAGE_COLS * (double)(1 << EDGE_FIXED_PT));
+          int32_t edge_x_step = (int32_t)((sizex / ((fractal_write->maxx - fractal_write->minx) * DISPLAY_COLS)) * IMAGE_COLS * (double)(1 << EDGE_FIXED_PT));
+          edge_y += edge_y_step >> 1;
+          edge_x_start += edge_x_step >> 1;
+
+#ifdef COLUMN_MAP
+          for (int j = jmin; j < jmax; ++j) {
+            column_map[j] = image_col_offset(fractal_read, (x_start + j * x_step) >> ITERATION_FIXED_PT);
+          }
+#endif
+#if !defined(BILINEAR) && !defined(TILED_BUFFER)
+          // Buffer columns the display spans, if there are few enough that
+          // checking them for a single colour costs less than sampling
+          int16_t uniform_j0 = x_start >> ITERATION_FIXED_PT;
+          int16_t uniform_j1 = (x_start + (DISPLAY_COLS - 1) * x_step) >> ITERATION_FIXED_PT;
+          bool check_uniform = jmin == 0 && jmax == DISPLAY_COLS && uniform_j1 - uniform_j0 < 2 * DISPLAY_COLS;
+#endif
+
+          // A display row that samples the same buffer row and edge row as
+          // the one before it sends that again, and a row of one colour is
+          // sent by repeating the pixel.  Either leaves more time to
+          // generate in.  Rows are built into the row buffer that wasn't
+          // last built into, as the DMA may still be reading that.
+          int32_t last_row_key = INT32_MIN;
+          int32_t last_edge_i = 0;
+          int last_buff = 0;
+          bool last_uniform = false;
+          uint16_t last_colour = 0;
+
+          display.start_pixels(&display);
+          for (int i = 0; i < DISPLAY_ROWS; ++i, y += y_step, edge_y += edge_y_step) {
 
             // This generates fractal until the DMA channel is ready again
-            generate_steal(fractal_write, st7789_chan[i & 1]);
+            generate_steal(fractal_write, &display, i & 1);
+
+            bool in_buffer = i >= imin && i < imax;
+#ifdef BILINEAR
+            // Blended rows depend on the fraction of y too
+            int32_t row_key = in_buffer ? y : -1;
+#else
+            int32_t row_key = in_buffer ? y >> ITERATION_FIXED_PT : -1;
+#endif
+            bool edges = edge_passes && (!in_buffer || jmin > 0 || jmax < DISPLAY_COLS);
+            int32_t edge_i = edges ? edge_y >> EDGE_FIXED_PT : 0;
+            if (row_key == last_row_key && edge_i == last_edge_i) {
+              if (last_uniform) display.repeat_pixel(&display, i & 1, last_colour, DISPLAY_COLS);
+              else display.send_pixels(&display, i & 1, pixel_row_buff[last_buff], DISPLAY_COLS);
+              continue;
+            }
+            last_row_key = row_key;
+            last_edge_i = edge_i;
+
+            if (!in_buffer && edge_passes == 0) {
+              last_uniform = true;
+              last_colour = 0;
+              display.repeat_pixel(&display, i & 1, 0, DISPLAY_COLS);
+              continue;
+            }
+
+#if !defined(BILINEAR) && !defined(TILED_BUFFER)
+            if (in_buffer && check_uniform) {
+              const image_pixel_t* row = image_row_ptr(fractal_read, row_key);
+              if (row_uniform(fractal_read, row, uniform_j0, uniform_j1)) {
+                last_uniform = true;
+                last_colour = buffer_pixel(fractal_read, read_palette, row + uniform_j0);
+                display.repeat_pixel(&display, i & 1, last_colour, DISPLAY_COLS);
+                continue;
+              }
+            }
+#endif
 
-            if (i < imin || i >= imax) {
-              st7789_dma_repeat_pixel(st7789_chan, i & 1, 0, DISPLAY_COLS);
+            last_uniform = false;
+            last_buff ^= 1;
+            uint16_t* pixelptr = pixel_row_buff[last_buff];
+            if (!in_buffer) {
+              int32_t edge_x = edge_x_start;
+              for (int j = 0; j < DISPLAY_COLS; ++j, edge_x += edge_x_step) {
+                *pixelptr++ = edge_pixel(fractal_write, write_palette, edge_passes, edge_y, edge_x);
+              }
             }
             else {
+              for (int j = 0; j < jmin; ++j) {
+                *pixelptr++ = edge_pixel(fractal_write, write_palette, edge_passes, edge_y, edge_x_start + j * edge_x_step);
+              }
+#if defined(BILINEAR)
+              const int shift = ITERATION_FIXED_PT - SCALE_FIXED_PT;
+#ifdef RLE_BUFFER
+              // The scaler reads the two rows around y, decoded into a view
               int image_i = y >> ITERATION_FIXED_PT;
-
-              interp0->accum[0] = x_start;
-              interp0->base[2] = (uintptr_t)(fractal_read->buff + image_i * IMAGE_COLS);
-
-              uint16_t* pixelptr = pixel_row_buff[i & 1];
-              for (int j = 0; j < DISPLAY_COLS; ++j) {
-                uint8_t* iter = (uint8_t*)interp0->pop[2];
-                if (j < jmin || j >= jmax) {
-                  *pixelptr++ = 0;
-                } else {
-                  *pixelptr++ = palette[*iter];
-                }
+              memcpy(bilinear_rows[0], image_row(fractal_read, image_i), IMAGE_COLS);
+              memcpy(bilinear_rows[1], image_row(fractal_read, MIN(image_i + 1, IMAGE_ROWS - 1)), IMAGE_COLS);
+              scale_row_bilinear(&bilinear_view, read_palette, SMOOTH_BITS, (y - (image_i << ITERATION_FIXED_PT)) >> shift,
+                                 (x_start + jmin * x_step) >> shift, x_step >> shift, jmax - jmin, pixelptr);
+#else
+              scale_row_bilinear(fractal_read, read_palette, SMOOTH_BITS, y >> shift,
+                                 (x_start + jmin * x_step) >> shift, x_step >> shift, jmax - jmin, pixelptr);
+#endif
+              pixelptr += jmax - jmin;
+#elif defined(COLUMN_MAP)
+              const image_pixel_t* row = image_row_ptr(fractal_read, row_key);
+              for (int j = jmin; j < jmax; ++j) {
+                *pixelptr++ = buffer_pixel(fractal_read, read_palette, row + column_map[j]);
+              }
+#else
+              interp0->accum[0] = x_start + jmin * x_step;
+              interp0->base[2] = (uintptr_t)image_row_ptr(fractal_read, row_key);
+              for (int j = jmin; j < jmax; ++j) {
+                *pixelptr++ = buffer_pixel(fractal_read, read_palette, (const image_pixel_t*)(uintptr_t)interp_pop_full_result(interp0));
+              }
+#endif
+              for (int j = jmax; j < DISPLAY_COLS; ++j) {
+                *pixelptr++ = edge_pixel(fractal_write, write_palette, edge_passes, edge_y, edge_x_start + j * edge_x_step);
               }
-              st7789_dma_pixels(st7789_chan, i & 1, pixel_row_buff[i & 1], DISPLAY_COLS);
             }
+            display.send_pixels(&display, i & 1, pixel_row_buff[last_buff], DISPLAY_COLS);
           }
+#ifdef TELEMETRY
+          flush_telemetry();
+#endif
 
 #ifdef USE_NUNCHUCK
-          reset = nunchuck_zbutton();
-          lastzoom |= nunchuck_cbutton();
-
-          int joyx = nunchuck_joyx();
-          int joyy = nunchuck_joyy();
+          InputState input;
+          input_poll(&input_trace, &input);
+          reset = input.zbutton;
+          lastzoom |= input.cbutton;
 
-          if (abs(joyx) > 7) zoomx += (joyx >> 3) * sizex * 0.001f;
-          if (abs(joyy) > 7) zoomy += (joyy >> 3) * sizey * 0.001f;
+          zoomx += pan_step(input.joyx) * sizex;
+          zoomy += pan_step(input.joyy) * sizey;
+#ifdef PAN_PREDICTION
+          pan_update(&pan, input.joyx, input.joyy);
+#endif
 
+          double pannedx = zoomx;
+          double pannedy = zoomy;
           if (zoomx > zoommaxx) zoomx = zoommaxx;
           if (zoomx < zoomminx) zoomx = zoomminx;
           if (zoomy > zoommaxy) zoomy = zoommaxy;
           if (zoomy < zoomminy) zoomy = zoomminy;
+          clamps += zoomx != pannedx || zoomy != pannedy;
 #else
-          if (zoomx < next_zoomx) zoomx = MIN(next_zoomx, zoomx + sizex * 0.0005f);
-          if (zoomx > next_zoomx) zoomx = MAX(next_zoomx, zoomx - sizex * 0.0005f);
-          if (zoomy < next_zoomy) zoomy = MIN(next_zoomy, zoomy + sizey * 0.0005f);
-          if (zoomy > next_zoomy) zoomy = MAX(next_zoomy, zoomy - sizey * 0.0005f);
+          if (zoomx < next_zoomx) zoomx = MIN(next_zoomx, zoomx + sizex * 0.0005);
+          if (zoomx > next_zoomx) zoomx = MAX(next_zoomx, zoomx - sizex * 0.0005);
+          if (zoomy < next_zoomy) zoomy = MIN(next_zoomy, zoomy + sizey * 0.0005);
+          if (zoomy > next_zoomy) zoomy = MAX(next_zoomy, zoomy - sizey * 0.0005);
 #endif
 
           if (lastzoom || reset) break;
@@ -358,7 +1078,9 @@ int main()
           sizex = maxx - minx;
           sizey = maxy - miny;
 
-          if (multicore_fifo_rvalid() &&
+          bool ready = input_ready(&input_trace, multicore_fifo_rvalid());
+          if (ready && ready_frame == 0) ready_frame = iz;
+          if (ready &&
               minx >= fractal_write->minx &&
               maxx <= fractal_write->maxx &&
               miny >= fractal_write->miny &&
@@ -369,11 +1091,33 @@ int main()
         }
         absolute_time_t stop_time = get_absolute_time();
         uint32_t time_diff = absolute_time_diff_us(start_time, stop_time);
-        printf("Frames in %dus (%d frames at %d FPS)\n", time_diff, iz, (iz * 1000000) / time_diff);
+#ifndef TELEMETRY
+        printf("Frames in %dus (%d frames at %d FPS) %d clamps %d border rows\n", time_diff, iz, (iz * 1000000) / time_diff,
+               clamps, (int)border_rows);
+#endif
+#if defined(USE_NUNCHUCK) && defined(PAN_PREDICTION)
+        pan_generated(&pan, ready_frame ? ready_frame : iz);
+#else
+        (void)ready_frame;
+#endif
 
-        if (!multicore_fifo_rvalid())
-          generate_steal_until_done(fractal_write);
+        // Always called, as core 0 may have claimed work that it needs to finish
+        generate_steal_until_done(fractal_write);
+#ifdef TELEMETRY
+        TelemetryRecord record;
+        record.generate_us = multicore_fifo_pop_blocking();
+        record.display_us = time_diff;
+        record.frames = iz;
+        record.clamps = clamps;
+        record.border_rows = border_rows;
+        telemetry_fill(&record, fractal_write);
+        telemetry_push(&record);
+#else
         multicore_fifo_pop_blocking();
+#endif
+#ifdef TILE_CACHE
+        fractal_cache_store(fractal_write);
+#endif
 
         if (fractal_write->count_inside == IMAGE_COLS*IMAGE_ROWS) {
           // Zoomed to completely inside the set.  Bail out
@@ -393,15 +1137,23 @@ int main()
         FractalBuffer* tmp = fractal_read;
         fractal_read = fractal_write;
         fractal_write = tmp;
+        uint16_t* tmp_palette = write_palette;
+        write_palette = read_palette;
+        read_palette = tmp_palette;
+#ifdef EQUALISE_PALETTE
+        equalise_frame_palette(fractal_read, palette, read_palette);
+#endif
       }
 
-      st7789_stop_pixels(pio, sm);
+      display.stop_pixels(&display);
 
       if (!reset) {
 #ifdef USE_NUNCHUCK
         for (int i = 0; i < 600; ++i) {
           sleep_ms(100);
-          if (nunchuck_zbutton()) break;
+          InputState input;
+          input_poll(&input_trace, &input);
+          if (input.zbutton) break;
         }
 #else
         sleep_ms(1000);
@@ -1,15 +1,47 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include "pico/stdlib.h"
 #include "hardware/interp.h"
-#include "hardware/dma.h"
+#include "hardware/sync.h"
 
 #include "mandelbrot.h"
+#include "display.h"
+
+#if FRACTAL_SIMD
+#include "mandel_simd.h"
+#endif
 
 // Cycle checking parameters
-#define MAX_CYCLE_LEN 8          // Must be power of 2
-#define MIN_CYCLE_CHECK_ITER 32  // Must be multiple of max cycle len
-#define CYCLE_TOLERANCE (1<<18)
+#define CYCLE_TOLERANCE_SHIFT 6   // Cycle tolerance is the pixel step shifted down by this
+#define DERIVATIVE_LIMIT (2<<26)  // Clamp for derivative components, keeps 2 z dz in range
+#define DERIVATIVE_TOLERANCE (1<<16)  // Orbits whose derivative shrinks below this are inside
+
+// Smooth colouring continues escaped orbits to this radius squared
+#define SMOOTH_ESCAPE_SQUARE 65536.f
+#define SMOOTH_MAX_EXTRA 8
+
+// Escape histogram used to choose the next iteration window.  max_iter is
+// raised when more than 1/WINDOW_TOP_FRACTION of escaped pixels are in the
+// top bin.
+#define WINDOW_BINS 16
+#define WINDOW_TOP_FRACTION 64
+
+// Perturbation parameters
+#define REF_SEARCH_GRID 5        // Candidate references tried per axis
+#define SA_TOLERANCE (1.0 / (1 << 20))  // Max relative size of ignored series terms
+
+// Work queue and Mariani-Silver parameters
+#define TILE_SIZE 8       // Target size of the tiles claimed by each worker
+#define MS_BLOCK_SIZE 34  // Target tile size for Mariani-Silver
+#define PASS_BAND 8       // Rows in each tile of a progressive pass
+#define MS_MIN_SIZE 4     // Rectangles with an interior this small are iterated directly
+
+enum { MS_BORDER, MS_CHECK, MS_INTERIOR, MS_SPLIT };
+
+// Protects claiming of work shared between the cores
+static spin_lock_t* mandel_lock;
 
 // Fixed point with 6 bits to the left of the point.
 // Range [-32,32) with precision 2^-26
@@ -17,6 +49,26 @@ typedef int32_t fixed_pt_t;
 
 #define ESCAPE_SQUARE (4<<26)
 
+// Fixed point with 4 bits to the left of the point, in one word with
+// exact 32x32->64 products, or in a double word.
+// Ranges [-8,8) with precision 2^-28 and 2^-60.
+typedef int32_t fixed28_t;
+typedef int64_t fixed60_t;
+
+#define ESCAPE_SQUARE_28 ((int64_t)4 << 56)
+#define ESCAPE_SQUARE_60 ((uint64_t)4 << 60)
+
+// Bounds of the main cardioid and period-2 bulb, which together span
+// x in [-1.25, 0.375] and |y| <= 3*sqrt(3)/8.
+#define BULBS_MIN_X -1.25
+#define BULBS_MAX_X 0.375
+#define BULBS_MAX_Y 0.6496
+#define CARDIOID_MIN_X -0.75
+
+// Smallest pixel step the Q6.26 kernel is used for.  This leaves a few bits
+// of headroom below the step for the error that builds up while iterating.
+#define MIN_INC_Q6_26 (1.0 / (1 << 20))
+
 static inline fixed_pt_t mul(fixed_pt_t a, fixed_pt_t b)
 {
   int32_t ah = a >> 13;
@@ -70,8 +122,34 @@ fixed_pt_t make_fixedf(float x) {
   return (int32_t)(x * (67108864.f));
 }
 
+static fixed_pt_t make_fixedd(double x) {
+  return (int32_t)(x * 67108864.0);
+}
+
+static fixed60_t make_fixed60(double x) {
+  return (int64_t)(x * 1152921504606846976.0);
+}
+
+// Q4.60 multiply built from 32x32->64 partial products.  The partial
+// products are truncated separately so the result may be up to 3 lsb low.
+static inline fixed60_t mul60(fixed60_t a, fixed60_t b)
+{
+  int32_t ah = a >> 32;
+  uint32_t al = (uint32_t)a;
+  int32_t bh = b >> 32;
+  uint32_t bl = (uint32_t)b;
+
+  int64_t hh = (int64_t)ah * bh;
+  int64_t hl = (int64_t)ah * (int64_t)bl;
+  int64_t lh = (int64_t)al * (int64_t)bh;
+  uint64_t ll = (uint64_t)al * bl;
+  return (hh << 4) + (hl >> 28) + (lh >> 28) + (int64_t)(ll >> 60);
+}
+
 void mandel_init()
 {
+  if (!mandel_lock) mandel_lock = spin_lock_init(spin_lock_claim_unused(true));
+
   // Not curently used
   interp_config cfg = interp_default_config();
   interp_config_set_add_raw(&cfg, false);
@@ -84,153 +162,1642 @@ void mandel_init()
   interp_set_config(interp0, 1, &cfg);
 }
 
+// Iterate c = x0 + y0 i in double precision, returns the escape iteration
+// or max_iter if it didn't escape.
+static uint16_t iterate_double(double x0, double y0, uint16_t k, uint16_t max_iter)
+{
+  double x = x0;
+  double y = y0;
+  for (; k < max_iter; ++k) {
+    double x_square = x * x;
+    double y_square = y * y;
+    if (x_square + y_square > 4.0) break;
+
+    y = 2.0 * x * y + y0;
+    x = x_square - y_square + x0;
+  }
+  return k;
+}
+
+// Double-double numbers, hi + lo with |lo| <= ulp(hi) / 2, for the
+// reference orbit.  Its rounding errors grow like the pixel deltas do, so
+// it needs about twice the precision of a double to stay ahead of them.
+typedef struct { double hi, lo; } dd_t;
+
+// a + b, given |a| >= |b|
+static inline dd_t dd_quick_sum(double a, double b)
+{
+  double s = a + b;
+  return (dd_t){ s, b - (s - a) };
+}
+
+static inline dd_t dd_sum(double a, double b)
+{
+  double s = a + b;
+  double v = s - a;
+  return (dd_t){ s, (a - (s - v)) + (b - v) };
+}
+
+// Exact a * b by Dekker's splitting, as there may be no fused multiply add
+static inline dd_t dd_prod(double a, double b)
+{
+  double ca = 134217729.0 * a;
+  double cb = 134217729.0 * b;
+  double ah = ca - (ca - a), al = a - ah;
+  double bh = cb - (cb - b), bl = b - bh;
+  double p = a * b;
+  return (dd_t){ p, ((ah * bh - p) + ah * bl + al * bh) + al * bl };
+}
+
+static inline dd_t dd_add(dd_t a, dd_t b)
+{
+  dd_t s = dd_sum(a.hi, b.hi);
+  return dd_quick_sum(s.hi, s.lo + a.lo + b.lo);
+}
+
+static inline dd_t dd_mul(dd_t a, dd_t b)
+{
+  dd_t p = dd_prod(a.hi, b.hi);
+  return dd_quick_sum(p.hi, p.lo + a.hi * b.lo + a.lo * b.hi);
+}
+
+// Compute the high precision reference orbit for perturbation, and the
+// series approximation used to skip the early iterations of every pixel.
+static void init_perturbation(FractalBuffer* f)
+{
+  double incx = (f->maxx - f->minx) / (f->cols - 1);
+  double incy = (f->maxy - f->miny) / (f->rows - 1);
+
+  // Use the centre as the reference unless it escapes, in which case
+  // pick the candidate from a small grid that survives longest.
+  double refx = 0.5 * (f->minx + f->maxx);
+  double refy = 0.5 * (f->miny + f->maxy);
+  uint16_t best_len = iterate_double(refx, refy, 1, f->max_iter);
+  for (int gi = 0; gi < REF_SEARCH_GRID && best_len < f->max_iter; ++gi) {
+    for (int gj = 0; gj < REF_SEARCH_GRID && best_len < f->max_iter; ++gj) {
+      double x = f->minx + (gj + 0.5) * (f->maxx - f->minx) / REF_SEARCH_GRID;
+      double y = f->miny + (gi + 0.5) * (f->maxy - f->miny) / REF_SEARCH_GRID;
+      uint16_t len = iterate_double(x, y, 1, f->max_iter);
+      if (len > best_len) {
+        best_len = len;
+        refx = x;
+        refy = y;
+      }
+    }
+  }
+
+  f->refx = refx;
+  f->refy = refy;
+  f->pert_minx = f->minx - refx;
+  f->pert_miny = f->miny - refy;
+  f->pert_incx = incx;
+  f->pert_incy = incy;
+  f->glitch_count = 0;
+
+  // Largest |dc| of any pixel, for bounding the series terms
+  double r = hypot(fmax(refx - f->minx, f->maxx - refx), fmax(refy - f->miny, f->maxy - refy));
+
+  // Reference orbit Z, starting from Z_0 = 0, and series coefficients
+  // for dz_n ~= A_n dc + B_n dc^2 + C_n dc^3, starting from n = 1.
+  pert_float_t* orbit = f->ref_orbit;
+  orbit[0] = 0;
+  orbit[1] = 0;
+  dd_t zx_dd = { refx, 0.0 }, zy_dd = { refy, 0.0 };
+  double ax = 1.0, ay = 0.0, bx = 0.0, by = 0.0, cx = 0.0, cy = 0.0;
+  bool sa_valid = true;
+  f->sa_skip = 1;
+  f->sa_coeff[0] = 1;
+  for (int c = 1; c < 6; ++c) f->sa_coeff[c] = 0;
+
+  uint16_t n = 1;
+  for (; n < f->max_iter; ++n) {
+    double zx = zx_dd.hi, zy = zy_dd.hi;
+    orbit[2*n] = zx;
+    orbit[2*n+1] = zy;
+    double zmag = zx * zx + zy * zy;
+    if (zmag > 4.0) break;
+
+    if (sa_valid) {
+      // Skip to this iteration only if the ignored terms are negligible,
+      // no pixel can have escaped and no pixel would need rebasing.
+      double amag = hypot(ax, ay) * r;
+      double bmag = hypot(bx, by) * r * r;
+      double cmag = hypot(cx, cy) * r * r * r;
+      double dmag = amag + bmag + cmag;
+      double z = sqrt(zmag);
+      if (cmag <= SA_TOLERANCE * amag && z + dmag < 2.0 && z > 2.0 * dmag) {
+        f->sa_skip = n;
+        f->sa_coeff[0] = ax;
+        f->sa_coeff[1] = ay;
+        f->sa_coeff[2] = bx;
+        f->sa_coeff[3] = by;
+        f->sa_coeff[4] = cx;
+        f->sa_coeff[5] = cy;
+      } else {
+        sa_valid = false;
+      }
+    }
+
+    // C' = 2ZC + 2AB, B' = 2ZB + A^2, A' = 2ZA + 1
+    double ncx = 2.0 * (zx * cx - zy * cy + ax * bx - ay * by);
+    double ncy = 2.0 * (zx * cy + zy * cx + ax * by + ay * bx);
+    double nbx = 2.0 * (zx * bx - zy * by) + ax * ax - ay * ay;
+    double nby = 2.0 * (zx * by + zy * bx + ax * ay);
+    double nax = 2.0 * (zx * ax - zy * ay) + 1.0;
+    double nay = 2.0 * (zx * ay + zy * ax);
+    cx = ncx; cy = ncy;
+    bx = nbx; by = nby;
+    ax = nax; ay = nay;
+
+    dd_t x_square = dd_mul(zx_dd, zx_dd);
+    dd_t y_square = dd_mul(zy_dd, zy_dd);
+    dd_t xy = dd_mul(zx_dd, zy_dd);
+    zx_dd = dd_add(dd_add(x_square, (dd_t){ -y_square.hi, -y_square.lo }), (dd_t){ refx, 0.0 });
+    zy_dd = dd_add((dd_t){ 2.0 * xy.hi, 2.0 * xy.lo }, (dd_t){ refy, 0.0 });
+  }
+  f->ref_len = n;
+}
+
+// Closed form membership tests for the main cardioid and period-2 bulb:
+//   (x+1)^2 + y^2 <= 1/16
+//   q (q + x - 1/4) <= y^2 / 4, where q = (x - 1/4)^2 + y^2
+// Points outside the bounding box are rejected first, which also keeps the
+// intermediate values in range.
+#define FIXED_CONST(x) ((fixed_pt_t)((x) * 67108864.0))
+#define FIXED60_CONST(x) ((fixed60_t)((x) * 1152921504606846976.0))
+
+static inline bool in_main_bulbs(fixed_pt_t x, fixed_pt_t y)
+{
+  if (x < FIXED_CONST(BULBS_MIN_X) || x > FIXED_CONST(BULBS_MAX_X) ||
+      y < -FIXED_CONST(BULBS_MAX_Y) || y > FIXED_CONST(BULBS_MAX_Y)) return false;
+
+  fixed_pt_t y_square = square(y);
+  if (x < FIXED_CONST(CARDIOID_MIN_X)) {
+    fixed_pt_t xb = x + FIXED_CONST(1);
+    return square(xb) + y_square <= FIXED_CONST(1. / 16);
+  }
+
+  fixed_pt_t xc = x - FIXED_CONST(0.25);
+  fixed_pt_t q = square(xc) + y_square;
+  return mul(q, q + xc) <= (y_square >> 2);
+}
+
+static inline bool in_main_bulbs60(fixed60_t x, fixed60_t y)
+{
+  if (x < FIXED60_CONST(BULBS_MIN_X) || x > FIXED60_CONST(BULBS_MAX_X) ||
+      y < -FIXED60_CONST(BULBS_MAX_Y) || y > FIXED60_CONST(BULBS_MAX_Y)) return false;
+
+  fixed60_t y_square = mul60(y, y);
+  if (x < FIXED60_CONST(CARDIOID_MIN_X)) {
+    fixed60_t xb = x + FIXED60_CONST(1);
+    return mul60(xb, xb) + y_square <= FIXED60_CONST(1. / 16);
+  }
+
+  fixed60_t xc = x - FIXED60_CONST(0.25);
+  fixed60_t q = mul60(xc, xc) + y_square;
+  return mul60(q, q + xc) <= (y_square >> 2);
+}
+
+static inline bool in_main_bulbs_double(double x, double y)
+{
+  if (x < BULBS_MIN_X || x > BULBS_MAX_X || y < -BULBS_MAX_Y || y > BULBS_MAX_Y) return false;
+
+  double y_square = y * y;
+  if (x < CARDIOID_MIN_X) return (x + 1.0) * (x + 1.0) + y_square <= 1. / 16;
+
+  double xc = x - 0.25;
+  double q = xc * xc + y_square;
+  return q * (q + xc) <= 0.25 * y_square;
+}
+
+// Cheapest kernel with enough precision for the pixel step.  Q4.28 only
+// has two more bits than Q6.26, and past Q6.26's steps the error it builds
+// up over a couple of hundred iterations changes the escape count of 5-15%
+// of the pixels of a view like the seahorse valley, so go on to Q4.60.
+static fractal_precision_t choose_precision(FractalBuffer* f)
+{
+  double inc = fmin(fabs(f->maxx - f->minx) / (f->cols - 1),
+                    fabs(f->maxy - f->miny) / (f->rows - 1));
+  if (inc >= MIN_INC_Q6_26) return FRACTAL_PRECISION_Q6_26;
+  return FRACTAL_PRECISION_Q4_60;
+}
+
+// Largest power of ratio that divides x no more than 1/64th
+static fixed_pt_t snap_step(fixed_pt_t x, int16_t ratio)
+{
+  fixed_pt_t step = 1;
+  while (step * ratio <= x / 64) step *= ratio;
+  return step;
+}
+
+void snap_fractal_viewport(FractalBuffer* f, const FractalBuffer* prev, int16_t ratio)
+{
+  fixed_pt_t iminx = make_fixedd(f->minx);
+  fixed_pt_t iminy = make_fixedd(f->miny);
+  fixed_pt_t incx, incy;
+
+  if (prev) {
+    if (prev->incx % ratio || prev->incy % ratio) return;
+
+    // Nearest point on the finer grid to the requested corner
+    incx = prev->incx / ratio;
+    incy = prev->incy / ratio;
+    iminx = prev->iminx + (fixed_pt_t)lround((double)(iminx - prev->iminx) / incx) * incx;
+    iminy = prev->iminy + (fixed_pt_t)lround((double)(iminy - prev->iminy) / incy) * incy;
+  } else {
+    // Start a new sequence of zooms with steps that can be divided by
+    // ratio many times
+    incx = (make_fixedd(f->maxx) - iminx) / (f->cols - 1);
+    incy = (make_fixedd(f->maxy) - iminy) / (f->rows - 1);
+    fixed_pt_t stepx = snap_step(incx, ratio);
+    fixed_pt_t stepy = snap_step(incy, ratio);
+    incx -= incx % stepx;
+    incy -= incy % stepy;
+    iminx -= iminx % incx;
+    iminy -= iminy % incy;
+  }
+
+  f->minx = iminx / 67108864.0;
+  f->maxx = (iminx + incx * (f->cols - 1)) / 67108864.0;
+  f->miny = iminy / 67108864.0;
+  f->maxy = (iminy + incy * (f->rows - 1)) / 67108864.0;
+}
+
+// Work out how the grid relates to reuse_from's, if samples can be reused
+static void init_reuse(FractalBuffer* f)
+{
+  const FractalBuffer* prev = f->reuse_from;
+  f->reuse_ratio = 0;
+  f->reuse_count = 0;
+  if (!prev || f->use_perturbation || prev->use_perturbation || prev->layout == FRACTAL_LAYOUT_RLE) return;
+  if (f->active_precision != FRACTAL_PRECISION_Q6_26 || prev->active_precision != FRACTAL_PRECISION_Q6_26) return;
+  if (f->max_iter > prev->max_iter || f->iter_offset < prev->iter_offset || f->iter16 != prev->iter16 ||
+      !f->smooth != !prev->smooth ||
+      f->use_cycle_check != prev->use_cycle_check ||
+      f->use_derivative_check != prev->use_derivative_check) return;
+  if (f->formula != prev->formula ||
+      (f->formula == FRACTAL_FORMULA_JULIA && (f->julia_cx != prev->julia_cx || f->julia_cy != prev->julia_cy))) return;
+  if (prev->incx % f->incx || prev->incy % f->incy) return;
+  if (prev->incx / f->incx != prev->incy / f->incy) return;
+  if ((prev->iminx - f->iminx) % f->incx || (prev->iminy - f->iminy) % f->incy) return;
+
+  f->reuse_ratio = prev->incx / f->incx;
+  f->reuse_base_i = (prev->iminy - f->iminy) / f->incy;
+  f->reuse_base_j = (prev->iminx - f->iminx) / f->incx;
+}
+
+// Tile cache flags
+#define CACHE_CYCLE_CHECK 1
+#define CACHE_DERIVATIVE_CHECK 2
+#define CACHE_INSIDE 4   // Some pixels didn't escape within max_iter
+#define CACHE_CLAMPED 8  // Values of 1 may have escaped before iter_offset
+
+void fractal_cache_init(FractalCache* cache, FractalCacheTile* tiles, uint16_t num_tiles,
+                        uint16_t* buckets, uint16_t num_buckets)
+{
+  cache->tiles = tiles;
+  cache->num_tiles = MIN(num_tiles, FRACTAL_CACHE_NONE);
+  cache->buckets = buckets;
+  cache->bucket_mask = num_buckets - 1;
+  for (int b = 0; b < num_buckets; ++b) buckets[b] = FRACTAL_CACHE_NONE;
+  cache->tiles_used = 0;
+  cache->newest = FRACTAL_CACHE_NONE;
+  cache->oldest = FRACTAL_CACHE_NONE;
+  cache->lookups = 0;
+  cache->hits = 0;
+  cache->evictions = 0;
+}
+
+void fractal_cache_snap_viewport(FractalBuffer* f)
+{
+  double inc = (f->maxx - f->minx) / (f->cols - 1);
+  int level = lround(log2(FRACTAL_CACHE_STEP0 / (inc * 67108864.0)));
+  if (level < 0 || level > FRACTAL_CACHE_MAX_LEVEL) return;
+  fixed_pt_t step = FRACTAL_CACHE_STEP0 >> level;
+
+  // Keep the centre pixel nearest the centre
+  fixed_pt_t iminx = ((fixed_pt_t)lround(make_fixedd(0.5 * (f->minx + f->maxx)) / (double)step) - (f->cols - 1) / 2) * step;
+  fixed_pt_t iminy = ((fixed_pt_t)lround(make_fixedd(0.5 * (f->miny + f->maxy)) / (double)step) - (f->rows - 1) / 2) * step;
+  f->minx = iminx / 67108864.0;
+  f->maxx = (iminx + step * (f->cols - 1)) / 67108864.0;
+  f->miny = iminy / 67108864.0;
+  f->maxy = (iminy + step * (f->rows - 1)) / 67108864.0;
+}
+
+static inline uint16_t cache_bucket(const FractalCache* cache, int8_t level, int32_t ti, int32_t tj)
+{
+  return ((uint32_t)ti * 73856093u ^ (uint32_t)tj * 19349663u ^ (uint32_t)level * 83492791u) & cache->bucket_mask;
+}
+
+static uint16_t cache_find(const FractalCache* cache, int8_t level, int32_t ti, int32_t tj)
+{
+  uint16_t t = cache->buckets[cache_bucket(cache, level, ti, tj)];
+  while (t != FRACTAL_CACHE_NONE) {
+    const FractalCacheTile* tile = &cache->tiles[t];
+    if (tile->ti == ti && tile->tj == tj && tile->level == level) break;
+    t = tile->chain;
+  }
+  return t;
+}
+
+static uint8_t cache_settings(const FractalBuffer* f)
+{
+  return (f->use_cycle_check ? CACHE_CYCLE_CHECK : 0) | (f->use_derivative_check ? CACHE_DERIVATIVE_CHECK : 0);
+}
+
+// Work out where the view is on the cache grid, if the cache can be used
+static void init_cache(FractalBuffer* f)
+{
+  f->cache_level = -1;
+  f->cache_lookups = 0;
+  f->cache_hits = 0;
+  for (int w = 0; w < FRACTAL_MAX_WORKERS; ++w) {
+    for (int d = 0; d < 3; ++d) {
+      f->workers[w].cache_ti[d] = INT32_MIN;
+      f->workers[w].cache_tile[d] = NULL;
+    }
+  }
+  if (!f->cache || f->use_perturbation || f->smooth || f->layout == FRACTAL_LAYOUT_RLE ||
+      f->formula != FRACTAL_FORMULA_MANDELBROT || f->active_precision != FRACTAL_PRECISION_Q6_26) return;
+  if (f->incx != f->incy || f->iminx % f->incx || f->iminy % f->incy) return;
+
+  for (int8_t level = 0; level <= FRACTAL_CACHE_MAX_LEVEL; ++level) {
+    if (f->incx == FRACTAL_CACHE_STEP0 >> level) {
+      f->cache_level = level;
+      f->cache_base_i = f->iminy / f->incy;
+      f->cache_base_j = f->iminx / f->incx;
+    }
+  }
+}
+
+// Copy tile (ti, tj) of f into tile, returning false if its values don't
+// fit in a byte
+static bool cache_fill(const FractalBuffer* f, FractalCacheTile* tile, int32_t ti, int32_t tj)
+{
+  int16_t i0 = ti * FRACTAL_CACHE_TILE_SIZE - f->cache_base_i;
+  int16_t j0 = tj * FRACTAL_CACHE_TILE_SIZE - f->cache_base_j;
+  uint16_t min_k = UINT16_MAX, max_k = 0;
+  bool inside = false;
+  for (int16_t i = i0; i < i0 + FRACTAL_CACHE_TILE_SIZE; ++i) {
+    for (int16_t j = j0; j < j0 + FRACTAL_CACHE_TILE_SIZE; ++j) {
+      uint16_t k = fractal_pixel(f, i, j);
+      if (k == 0) inside = true;
+      else {
+        min_k = MIN(min_k, k);
+        max_k = MAX(max_k, k);
+      }
+    }
+  }
+  if (max_k == 0) min_k = 1;
+  if (max_k - min_k >= 255) return false;
+
+  tile->ti = ti;
+  tile->tj = tj;
+  tile->level = f->cache_level;
+  tile->flags = cache_settings(f) | (inside ? CACHE_INSIDE : 0);
+  if (min_k == 1 && f->iter_offset > 0) tile->flags |= CACHE_CLAMPED;
+  tile->max_iter = f->max_iter;
+  tile->iter_offset = f->iter_offset + min_k - 1;
+  uint8_t* value = tile->values;
+  for (int16_t i = i0; i < i0 + FRACTAL_CACHE_TILE_SIZE; ++i) {
+    for (int16_t j = j0; j < j0 + FRACTAL_CACHE_TILE_SIZE; ++j) {
+      uint16_t k = fractal_pixel(f, i, j);
+      *value++ = k ? k - (min_k - 1) : 0;
+    }
+  }
+  return true;
+}
+
+static void cache_unlink(FractalCache* cache, uint16_t t)
+{
+  FractalCacheTile* tile = &cache->tiles[t];
+  if (tile->older != FRACTAL_CACHE_NONE) cache->tiles[tile->older].newer = tile->newer;
+  else cache->oldest = tile->newer;
+  if (tile->newer != FRACTAL_CACHE_NONE) cache->tiles[tile->newer].older = tile->older;
+  else cache->newest = tile->older;
+}
+
+static void cache_make_newest(FractalCache* cache, uint16_t t)
+{
+  FractalCacheTile* tile = &cache->tiles[t];
+  tile->older = cache->newest;
+  tile->newer = FRACTAL_CACHE_NONE;
+  if (cache->newest != FRACTAL_CACHE_NONE) cache->tiles[cache->newest].newer = t;
+  else cache->oldest = t;
+  cache->newest = t;
+}
+
+// Take the oldest tile out of the cache, returning its slot
+static uint16_t cache_evict(FractalCache* cache)
+{
+  uint16_t t = cache->oldest;
+  FractalCacheTile* tile = &cache->tiles[t];
+  cache_unlink(cache, t);
+  uint16_t* link = &cache->buckets[cache_bucket(cache, tile->level, tile->ti, tile->tj)];
+  while (*link != t) link = &cache->tiles[*link].chain;
+  *link = tile->chain;
+  cache->evictions++;
+  return t;
+}
+
+void fractal_cache_store(FractalBuffer* f)
+{
+  FractalCache* cache = f->cache;
+  if (!cache || f->cache_level < 0 || !f->done) return;
+  cache->lookups += f->cache_lookups;
+  cache->hits += f->cache_hits;
+  if (cache->num_tiles == 0) return;
+
+  // Tiles entirely within the view
+  int32_t ti0 = (f->cache_base_i + FRACTAL_CACHE_TILE_SIZE - 1) >> 3;
+  int32_t ti1 = (f->cache_base_i + f->rows) >> 3;
+  int32_t tj0 = (f->cache_base_j + FRACTAL_CACHE_TILE_SIZE - 1) >> 3;
+  int32_t tj1 = (f->cache_base_j + f->cols) >> 3;
+  for (int32_t ti = ti0; ti < ti1; ++ti) {
+    for (int32_t tj = tj0; tj < tj1; ++tj) {
+      FractalCacheTile tile;
+      if (!cache_fill(f, &tile, ti, tj)) continue;
+
+      uint16_t t = cache_find(cache, f->cache_level, ti, tj);
+      if (t != FRACTAL_CACHE_NONE) {
+        tile.chain = cache->tiles[t].chain;
+        cache_unlink(cache, t);
+      } else {
+        t = cache->tiles_used < cache->num_tiles ? cache->tiles_used++ : cache_evict(cache);
+        uint16_t* bucket = &cache->buckets[cache_bucket(cache, tile.level, ti, tj)];
+        tile.chain = *bucket;
+        *bucket = t;
+      }
+      cache->tiles[t] = tile;
+      cache_make_newest(cache, t);
+    }
+  }
+}
+
+// Defined with the kernels below
+static fractal_kernel_t choose_kernel(const FractalBuffer* f);
+
 void init_fractal(FractalBuffer* f)
 {
   f->done = false;
   f->min_iter = f->max_iter - 1;
-  f->iminx = make_fixedf(f->minx);
-  f->imaxx = make_fixedf(f->maxx);
-  f->iminy = make_fixedf(f->miny);
-  f->imaxy = make_fixedf(f->maxy);
+  f->iminx = make_fixedd(f->minx);
+  f->imaxx = make_fixedd(f->maxx);
+  f->iminy = make_fixedd(f->miny);
+  f->imaxy = make_fixedd(f->maxy);
   f->incx = (f->imaxx - f->iminx) / (f->cols - 1);
   f->incy = (f->imaxy - f->iminy) / (f->rows - 1);
+  f->cycle_tolerance = MAX(1, MIN(f->incx, f->incy) >> CYCLE_TOLERANCE_SHIFT);
   f->count_inside = 0;
-  f->iend = f->cols - 1;
-  f->jend = f->rows - 1;
+  f->histogram_shift = 0;
+  while ((f->max_iter - f->iter_offset - 1) >> f->histogram_shift >= FRACTAL_HISTOGRAM_BINS) ++f->histogram_shift;
+  memset(f->histogram, 0, sizeof(f->histogram));
+  f->cycle_count = 0;
+  f->cycle_iters_saved = 0;
+  f->iterations = 0;
+  f->steal_idle = 0;
+  f->dma_stall_us = 0;
+
+  // Only test pixels against the cardioid and bulb if the view can contain them
+  f->check_bulbs = f->formula == FRACTAL_FORMULA_MANDELBROT &&
+                   f->minx <= BULBS_MAX_X && f->maxx >= BULBS_MIN_X &&
+                   f->miny <= BULBS_MAX_Y && f->maxy >= -BULBS_MAX_Y;
+
+  f->active_precision = f->precision;
+  if (f->active_precision == FRACTAL_PRECISION_AUTO) f->active_precision = choose_precision(f);
+  // Only the Mandelbrot set has a Q4.60 kernel
+  if (f->active_precision == FRACTAL_PRECISION_Q4_60 && f->formula != FRACTAL_FORMULA_MANDELBROT) {
+    f->active_precision = FRACTAL_PRECISION_Q4_28;
+  }
+  f->julia_x = make_fixedd(f->julia_cx);
+  f->julia_y = make_fixedd(f->julia_cy);
+  f->ljulia_x = make_fixed60(f->julia_cx);
+  f->ljulia_y = make_fixed60(f->julia_cy);
+  if (f->active_precision == FRACTAL_PRECISION_Q4_28 || f->active_precision == FRACTAL_PRECISION_Q4_60) {
+    fixed60_t lmaxx = make_fixed60(f->maxx);
+    fixed60_t lmaxy = make_fixed60(f->maxy);
+    f->lminx = make_fixed60(f->minx);
+    f->lminy = make_fixed60(f->miny);
+    f->lincx = (lmaxx - f->lminx) / (f->cols - 1);
+    f->lincy = (lmaxy - f->lminy) / (f->rows - 1);
+  }
+
+  init_reuse(f);
+  init_cache(f);
+
+  if (f->mode == FRACTAL_MODE_PROGRESSIVE) {
+    f->tiles_x = 1;
+    f->tiles_y = (f->rows + PASS_BAND - 1) / PASS_BAND;
+    f->num_tiles = f->tiles_y * FRACTAL_PASSES;
+  } else {
+    int16_t tile_size = (f->mode == FRACTAL_MODE_MARIANI_SILVER) ? MS_BLOCK_SIZE : TILE_SIZE;
+    f->tiles_x = MAX(1, f->cols / tile_size);
+    f->tiles_y = MAX(1, f->rows / tile_size);
+    if (f->layout == FRACTAL_LAYOUT_RLE) f->tiles_y = (f->rows + FRACTAL_RLE_BAND_ROWS - 1) / FRACTAL_RLE_BAND_ROWS;
+    f->num_tiles = f->tiles_x * f->tiles_y;
+  }
+  for (int slot = 0; slot < FRACTAL_RLE_RING_BANDS; ++slot) f->slot_band[slot] = -1;
+  f->encoding = false;
+  f->bands_encoded = 0;
+  f->rows_encoded = 0;
+  f->rle_used = 0;
+  f->rle_reduced_rows = 0;
+  f->tile_next = 0;
+  f->tiles_done = 0;
+  f->passes_done = 0;
+  memset(f->pass_tiles_done, 0, sizeof(f->pass_tiles_done));
+  for (int w = 0; w < FRACTAL_MAX_WORKERS; ++w) {
+    FractalWorker* worker = &f->workers[w];
+    worker->tile = -1;
+    worker->depth = 0;
+    worker->count_inside = 0;
+    worker->min_iter = UINT16_MAX;
+    worker->reuse_count = 0;
+    worker->glitch_count = 0;
+    worker->cycle_count = 0;
+    worker->cycle_iters_saved = 0;
+    worker->iterations = 0;
+    worker->cache_lookups = 0;
+    worker->cache_hits = 0;
+    memset(worker->histogram, 0, sizeof(worker->histogram));
+    worker->pixels = 0;
+  }
+
+  if (f->use_perturbation && f->formula == FRACTAL_FORMULA_MANDELBROT) init_perturbation(f);
+  f->kernel = choose_kernel(f);
+}
+
+void choose_iteration_window(FractalBuffer* f, const FractalBuffer* prev, uint16_t min_max_iter, uint16_t max_max_iter)
+{
+  // Escaped values, which are 1 to max_iter - iter_offset - 1, from the
+  // histogram prev was generated with.  Each of its bins is counted at its
+  // lowest value.  With a shift, bin 0 holds low escapes as well as inside.
+  uint32_t hist[WINDOW_BINS] = { 0 };
+  uint32_t escaped = 0;
+  uint16_t window = prev->max_iter - prev->iter_offset;
+  for (uint32_t b = 0; b < FRACTAL_HISTOGRAM_BINS; ++b) {
+    uint32_t count = prev->histogram[b];
+    if (b == 0) count -= MIN(count, prev->count_inside);
+    if (count == 0) continue;
+    uint32_t k = MAX(1, b << prev->histogram_shift);
+    hist[MIN((k - 1) * WINDOW_BINS / MAX(1, window - 1), WINDOW_BINS - 1)] += count;
+    escaped += count;
+  }
+
+  uint16_t max_iter = prev->max_iter;
+  uint16_t iter_offset = prev->iter_offset;
+  if (escaped) {
+    // Many pixels escaping at the top of the window suggests more are
+    // escaping just after it and being drawn as inside
+    if (hist[WINDOW_BINS - 1] > escaped / WINDOW_TOP_FRACTION) max_iter += max_iter / 4;
+    else if (hist[WINDOW_BINS - 1] == 0 && hist[WINDOW_BINS - 2] == 0) max_iter -= max_iter / 8;
+
+    // Start the window a little below the lowest escape, as panning can
+    // bring in pixels that escape sooner
+    uint16_t lowest = prev->min_iter + prev->iter_offset;
+    uint16_t margin = window / WINDOW_BINS + 1;
+    iter_offset = (lowest > margin) ? lowest - margin : 0;
+  }
+  max_iter = MAX(min_max_iter, MIN(max_max_iter, max_iter));
+
+  if (!f->iter16 && max_iter - iter_offset > 256) iter_offset = max_iter - 256;
+  if (iter_offset >= max_iter) iter_offset = max_iter - 1;
+  f->max_iter = max_iter;
+  f->iter_offset = iter_offset;
+}
+
+bool fractal_equalise_histogram(const FractalBuffer* f, uint16_t colours, uint16_t* entries)
+{
+  uint32_t escaped = 0;
+  for (uint32_t b = 0; b < FRACTAL_HISTOGRAM_BINS; ++b) escaped += f->histogram[b];
+  escaped -= MIN(escaped, f->count_inside);
+  if (escaped == 0) return false;
+
+  uint32_t below = 0;
+  for (uint32_t b = 0; b < FRACTAL_HISTOGRAM_BINS; ++b) {
+    uint32_t count = f->histogram[b];
+    if (b == 0) count -= MIN(count, f->count_inside);
+    entries[b] = 1 + (uint32_t)(((uint64_t)below + (count >> 1)) * (colours - 1) / escaped);
+    below += count;
+  }
+  return true;
+}
+
+static inline void store_iter(FractalBuffer* f, FractalWorker* w, uint16_t k, uint32_t index)
+{
+  if (k == f->max_iter) {
+    fractal_set_pixel(f, index, 0);
+    w->count_inside++;
+    w->histogram[0]++;
+  } else {
+    if (k > f->iter_offset) k -= f->iter_offset;
+    else k = 1;
+    fractal_set_pixel(f, index, k);
+    if (w->min_iter > k) w->min_iter = k;
+    w->histogram[k >> f->histogram_shift]++;
+  }
+}
+
+// The kernels below are specialised for each formula by passing it as a
+// constant, so the branches on it are resolved at compile time.
+
+// Interior check done by a kernel
+typedef enum { CHECK_NONE, CHECK_CYCLE, CHECK_DERIVATIVE } interior_check_t;
+
+// One iteration of formula from (x, y), given their squares
+static inline __attribute__((always_inline))
+void step_q6_26(fractal_formula_t formula, fixed_pt_t* x, fixed_pt_t* y, fixed_pt_t x_square, fixed_pt_t y_square,
+                fixed_pt_t cx, fixed_pt_t cy)
+{
+  fixed_pt_t nextx;
+  if (formula == FRACTAL_FORMULA_MULTIBROT3) {
+    // x^3 - 3xy^2, 3x^2y - y^3
+    nextx = mul(*x, x_square - 3 * y_square) + cx;
+    *y = mul(*y, 3 * x_square - y_square) + cy;
+  } else {
+    nextx = x_square - y_square + cx;
+    if (formula == FRACTAL_FORMULA_BURNING_SHIP) *y = mul2(abs(*x), abs(*y)) + cy;
+    else *y = mul2(*x, *y) + cy;
+  }
+  *x = nextx;
+}
+
+// z^3 + c can leave |z| <= 2 far enough for the squares to overflow, so
+// it is bounded first
+static inline __attribute__((always_inline))
+bool out_of_range_q6_26(fractal_formula_t formula, fixed_pt_t x, fixed_pt_t y)
+{
+  const fixed_pt_t two = FIXED_CONST(2);
+  return formula == FRACTAL_FORMULA_MULTIBROT3 && (x > two || x < -two || y > two || y < -two);
 }
 
-static inline void generate_one(FractalBuffer* f, fixed_pt_t x0, fixed_pt_t y0, uint8_t* buffptr)
+// z starts at (zx0, zy0), and is left where the orbit escaped in *zx, *zy
+static inline __attribute__((always_inline))
+uint16_t generate_one(const FractalBuffer* f, fractal_formula_t formula, fixed_pt_t zx0, fixed_pt_t zy0,
+                      fixed_pt_t cx, fixed_pt_t cy, fixed_pt_t* zx, fixed_pt_t* zy)
 {
-  fixed_pt_t x = x0;
-  fixed_pt_t y = y0;
+  const uint16_t max_iter = f->max_iter;
+  fixed_pt_t x = zx0;
+  fixed_pt_t y = zy0;
 
   uint16_t k = 1;
-  for (; k < f->max_iter; ++k) {
+  for (; k < max_iter; ++k) {
+    if (out_of_range_q6_26(formula, x, y)) break;
     fixed_pt_t x_square = square(x);
     fixed_pt_t y_square = square(y);
     if (x_square + y_square > ESCAPE_SQUARE) break;
+    step_q6_26(formula, &x, &y, x_square, y_square, cx, cy);
+  }
+  *zx = x;
+  *zy = y;
+  return k;
+}
+
+static inline __attribute__((always_inline))
+uint16_t generate_one_q4_28(const FractalBuffer* f, fractal_formula_t formula, fixed28_t zx0, fixed28_t zy0,
+                            fixed28_t cx, fixed28_t cy)
+{
+  const uint16_t max_iter = f->max_iter;
+  fixed28_t x = zx0;
+  fixed28_t y = zy0;
+
+  uint16_t k = 1;
+  for (; k < max_iter; ++k) {
+    int64_t x_square = (int64_t)x * x;
+    int64_t y_square = (int64_t)y * y;
+    if (x_square + y_square > ESCAPE_SQUARE_28) break;
 
-    fixed_pt_t nextx = x_square - y_square + x0;
-    y = mul2(x,y) + y0;
+    if (formula == FRACTAL_FORMULA_MULTIBROT3) {
+      // z^3 + c can go beyond the range of Q4.28, but anything beyond 4
+      // has escaped, so it is clamped there
+      int64_t xs = x_square >> 28, ys = y_square >> 28;
+      int64_t nextx = (((xs - 3 * ys) * x) >> 28) + cx;
+      int64_t nexty = (((3 * xs - ys) * y) >> 28) + cy;
+      const int64_t four = (int64_t)4 << 28;
+      x = (fixed28_t)MAX(-four, MIN(four, nextx));
+      y = (fixed28_t)MAX(-four, MIN(four, nexty));
+      continue;
+    }
+
+    fixed28_t nextx = (fixed28_t)((x_square - y_square) >> 28) + cx;
+    if (formula == FRACTAL_FORMULA_BURNING_SHIP) y = (fixed28_t)(((int64_t)abs(x) * abs(y)) >> 27) + cy;
+    else y = (fixed28_t)(((int64_t)x * y) >> 27) + cy;
     x = nextx;
   }
-  if (k == f->max_iter) {
-    *buffptr = 0;
-    f->count_inside++;
-  } else {
-    if (k > f->iter_offset) k -= f->iter_offset;
-    else k = 1;
-    *buffptr = k;
-    if (f->min_iter > k) f->min_iter = k;
+  return k;
+}
+
+// Only for the Mandelbrot set
+static inline uint16_t generate_one_q4_60(const FractalBuffer* f, fixed60_t x0, fixed60_t y0)
+{
+  const fixed60_t two = (fixed60_t)2 << 60;
+  const uint16_t max_iter = f->max_iter;
+  fixed60_t x = x0;
+  fixed60_t y = y0;
+
+  uint16_t k = 1;
+  for (; k < max_iter; ++k) {
+    // Squares would overflow beyond 2, and the point has escaped anyway
+    if (x > two || x < -two || y > two || y < -two) break;
+    fixed60_t x_square = mul60(x, x);
+    fixed60_t y_square = mul60(y, y);
+    if ((uint64_t)x_square + (uint64_t)y_square > ESCAPE_SQUARE_60) break;
+
+    fixed60_t nextx = x_square - y_square + x0;
+    y = (mul60(x, y) << 1) + y0;
+    x = nextx;
   }
+  return k;
 }
 
-static inline void generate_one_cycle_check(FractalBuffer* f, fixed_pt_t x0, fixed_pt_t y0, uint8_t* buffptr)
+// Periodicity checking with Brent's algorithm: the orbit is compared with
+// a saved point, which is moved on after windows that double in length, so
+// cycles of any length are found once the window has grown past them.  A
+// point that returns to within cycle_tolerance of the saved one is taken to
+// be in a cycle, and so inside the set.
+static inline __attribute__((always_inline))
+uint16_t generate_one_cycle_check(const FractalBuffer* f, FractalWorker* w, fractal_formula_t formula,
+                                  fixed_pt_t zx0, fixed_pt_t zy0, fixed_pt_t cx, fixed_pt_t cy,
+                                  fixed_pt_t* zx, fixed_pt_t* zy)
 {
-  fixed_pt_t x = x0;
-  fixed_pt_t y = y0;
-  fixed_pt_t oldx, oldy;
+  const fixed_pt_t tolerance = f->cycle_tolerance;
+  const uint16_t max_iter = f->max_iter;
+  fixed_pt_t x = zx0;
+  fixed_pt_t y = zy0;
+  fixed_pt_t oldx = zx0;
+  fixed_pt_t oldy = zy0;
+  uint16_t window = 1;
+  uint16_t next_save = 1;
 
   uint16_t k = 1;
-  for (; k < f->max_iter; ++k) {
+  for (; k < max_iter; ++k) {
+    if (out_of_range_q6_26(formula, x, y)) break;
     fixed_pt_t x_square = square(x);
     fixed_pt_t y_square = square(y);
     if (x_square + y_square > ESCAPE_SQUARE) break;
+    step_q6_26(formula, &x, &y, x_square, y_square, cx, cy);
 
-    if (k >= MIN_CYCLE_CHECK_ITER) {
-      if ((k & (MAX_CYCLE_LEN - 1)) == 0) {
-        oldx = x - CYCLE_TOLERANCE;
-        oldy = y - CYCLE_TOLERANCE;
-      }
-      else
-      {
-        if ((uint32_t)(x - oldx) < (2*CYCLE_TOLERANCE) && (uint32_t)(y - oldy) < (2*CYCLE_TOLERANCE)) {
-          // Found a cycle
-          k = f->max_iter;
-          break;
-        }
-      }
+    if ((uint32_t)(x - oldx + tolerance) <= (uint32_t)(2*tolerance) &&
+        (uint32_t)(y - oldy + tolerance) <= (uint32_t)(2*tolerance)) {
+      w->cycle_count++;
+      w->cycle_iters_saved += max_iter - k;
+      k = max_iter;
+      break;
     }
 
-    fixed_pt_t nextx = x_square - y_square + x0;
-    y = mul2(x,y) + y0;
+    if (k == next_save) {
+      oldx = x;
+      oldy = y;
+      window <<= 1;
+      next_save += window;
+    }
+  }
+  *zx = x;
+  *zy = y;
+  return k;
+}
+
+// Interior checking from the derivative of the orbit with respect to its
+// start point, which shrinks towards 0 when the orbit is attracted to a
+// cycle.  The derivative is clamped to keep the fixed point maths in range,
+// which only makes it smaller, so an orbit that is repelled for a while
+// before being attracted may be caught slightly early.  Only for z^2 + c.
+static inline __attribute__((always_inline))
+uint16_t generate_one_derivative_check(const FractalBuffer* f, FractalWorker* w, fixed_pt_t zx0, fixed_pt_t zy0,
+                                       fixed_pt_t cx, fixed_pt_t cy, fixed_pt_t* zx, fixed_pt_t* zy)
+{
+  const uint16_t max_iter = f->max_iter;
+  fixed_pt_t x = zx0;
+  fixed_pt_t y = zy0;
+  fixed_pt_t dx = FIXED_CONST(1);
+  fixed_pt_t dy = 0;
+
+  uint16_t k = 1;
+  for (; k < max_iter; ++k) {
+    fixed_pt_t x_square = square(x);
+    fixed_pt_t y_square = square(y);
+    if (x_square + y_square > ESCAPE_SQUARE) break;
+
+    // dz' = 2 z dz
+    fixed_pt_t nextdx = mul2(x, dx) - mul2(y, dy);
+    dy = mul2(x, dy) + mul2(y, dx);
+    dx = MAX(-DERIVATIVE_LIMIT, MIN(DERIVATIVE_LIMIT, nextdx));
+    dy = MAX(-DERIVATIVE_LIMIT, MIN(DERIVATIVE_LIMIT, dy));
+
+    if ((uint32_t)(dx + DERIVATIVE_TOLERANCE) <= (uint32_t)(2*DERIVATIVE_TOLERANCE) &&
+        (uint32_t)(dy + DERIVATIVE_TOLERANCE) <= (uint32_t)(2*DERIVATIVE_TOLERANCE)) {
+      w->cycle_count++;
+      w->cycle_iters_saved += max_iter - k;
+      k = max_iter;
+      break;
+    }
+
+    fixed_pt_t nextx = x_square - y_square + cx;
+    y = mul2(x,y) + cy;
     x = nextx;
   }
-  if (k == f->max_iter) {
-    *buffptr = 0;
-    f->count_inside++;
+  *zx = x;
+  *zy = y;
+  return k;
+}
+
+// Iterate the pixel as a delta from the reference orbit:
+//   dz' = 2 Z dz + dz^2 + dc
+// When |z| becomes smaller than |dz| the delta is rebased onto the start
+// of the reference orbit, which avoids the loss of precision that shows as
+// glitches.  If the reference escapes before the pixel does, the pixel is
+// recomputed directly in double precision.
+static inline uint16_t generate_one_perturbed(FractalBuffer* f, FractalWorker* w, int16_t i, int16_t j)
+{
+  const pert_float_t* orbit = f->ref_orbit;
+  const pert_float_t* sa = f->sa_coeff;
+  pert_float_t dcx = f->pert_minx + j * f->pert_incx;
+  pert_float_t dcy = f->pert_miny + i * f->pert_incy;
+
+  // Series approximation for the first sa_skip iterations
+  pert_float_t dc2x = dcx * dcx - dcy * dcy;
+  pert_float_t dc2y = 2.f * dcx * dcy;
+  pert_float_t dc3x = dc2x * dcx - dc2y * dcy;
+  pert_float_t dc3y = dc2x * dcy + dc2y * dcx;
+  pert_float_t dx = sa[0] * dcx - sa[1] * dcy + sa[2] * dc2x - sa[3] * dc2y + sa[4] * dc3x - sa[5] * dc3y;
+  pert_float_t dy = sa[0] * dcy + sa[1] * dcx + sa[2] * dc2y + sa[3] * dc2x + sa[4] * dc3y + sa[5] * dc3x;
+
+  if (f->check_bulbs && in_main_bulbs_double(f->refx + dcx, f->refy + dcy)) return f->max_iter;
+
+  uint16_t k = f->sa_skip;
+  uint16_t m = k;
+  for (; k < f->max_iter; ++k, ++m) {
+    if (m == f->ref_len) {
+      // Reference escaped, so the delta can't be trusted any more
+      w->glitch_count++;
+      k = iterate_double(f->refx + dcx, f->refy + dcy, 1, f->max_iter);
+      break;
+    }
+
+    pert_float_t zx = orbit[2*m] + dx;
+    pert_float_t zy = orbit[2*m+1] + dy;
+    pert_float_t zmag = zx * zx + zy * zy;
+    if (zmag > 4.f) break;
+
+    if (zmag < dx * dx + dy * dy) {
+      dx = zx;
+      dy = zy;
+      m = 0;
+    }
+
+    pert_float_t tx = 2.f * orbit[2*m] + dx;
+    pert_float_t ty = 2.f * orbit[2*m+1] + dy;
+    pert_float_t ndx = tx * dx - ty * dy + dcx;
+    dy = tx * dy + ty * dx + dcy;
+    dx = ndx;
+  }
+  return k;
+}
+
+// Smooth escape count for an orbit that escaped radius 2 at (zx, zy) after
+// *k iterations.  The orbit is continued in floats until it escapes a much
+// larger radius, as the usual log log formula is only continuous between
+// bands for a large escape radius.  *k is replaced by the integer part and
+// the fraction is returned in 1/256ths.
+static inline __attribute__((always_inline))
+uint8_t smooth_escape(const FractalBuffer* f, fractal_formula_t formula, uint16_t* k,
+                      fixed_pt_t zx, fixed_pt_t zy, fixed_pt_t cx0, fixed_pt_t cy0)
+{
+  const float scale = 1.f / (1 << 26);
+  float cx = cx0 * scale;
+  float cy = cy0 * scale;
+  float x = zx * scale;
+  float y = zy * scale;
+  float r2 = x * x + y * y;
+  int extra = 0;
+  for (; r2 <= SMOOTH_ESCAPE_SQUARE && extra < SMOOTH_MAX_EXTRA; ++extra) {
+    float nextx;
+    if (formula == FRACTAL_FORMULA_MULTIBROT3) {
+      nextx = x * (x * x - 3.f * y * y) + cx;
+      y = y * (3.f * x * x - y * y) + cy;
+    } else {
+      nextx = x * x - y * y + cx;
+      if (formula == FRACTAL_FORMULA_BURNING_SHIP) y = 2.f * fabsf(x * y) + cy;
+      else y = 2.f * x * y + cy;
+    }
+    x = nextx;
+    r2 = x * x + y * y;
+  }
+
+  // The log log term is in base d for z^d + c
+  float loglog = log2f(0.5f * log2f(r2));
+  if (formula == FRACTAL_FORMULA_MULTIBROT3) loglog *= 1.f / 1.5849625f;
+  float mu = *k + extra + 1 - loglog;
+  if (mu < 1.f) mu = 1.f;
+  if (mu >= f->max_iter - 1) mu = f->max_iter - 1;
+  *k = (uint16_t)mu;
+  return (uint8_t)((mu - *k) * 256.f);
+}
+
+// Copy the sample from the previous generation if it coincides with one
+static inline bool reuse_pixel(FractalBuffer* f, FractalWorker* w, int16_t i, int16_t j, uint32_t index)
+{
+  int16_t pi = i - f->reuse_base_i;
+  int16_t pj = j - f->reuse_base_j;
+  if (pi < 0 || pj < 0 || pi % f->reuse_ratio || pj % f->reuse_ratio) return false;
+  pi /= f->reuse_ratio;
+  pj /= f->reuse_ratio;
+
+  const FractalBuffer* prev = f->reuse_from;
+  if (pi >= prev->rows || pj >= prev->cols) return false;
+
+  // Move the sample to this buffer's iteration window
+  uint16_t k = fractal_pixel(prev, pi, pj);
+  if (k != 0) {
+    uint16_t escape = k + prev->iter_offset;
+    if (escape >= f->max_iter) k = 0;
+    else k = MAX(1, escape - f->iter_offset);
+  }
+  fractal_set_pixel(f, index, k);
+  if (f->smooth) f->smooth[index] = k ? prev->smooth[fractal_pixel_index(prev, pi, pj)] : 0;
+  if (k == 0) w->count_inside++;
+  else if (w->min_iter > k) w->min_iter = k;
+  w->histogram[k >> f->histogram_shift]++;
+  w->reuse_count++;
+  return true;
+}
+
+// Cached tile ti, tj at a level, if it can be used for this buffer.
+// d is the level's slot in the worker's memory of the last tile looked up.
+static inline const FractalCacheTile* cache_tile(FractalBuffer* f, FractalWorker* w, int d,
+                                                 int8_t level, int32_t ti, int32_t tj)
+{
+  if (w->cache_ti[d] == ti && w->cache_tj[d] == tj) return w->cache_tile[d];
+
+  const FractalCacheTile* tile = NULL;
+  uint16_t t = cache_find(f->cache, level, ti, tj);
+  if (t != FRACTAL_CACHE_NONE) {
+    tile = &f->cache->tiles[t];
+    if ((tile->flags & (CACHE_CYCLE_CHECK | CACHE_DERIVATIVE_CHECK)) != cache_settings(f) ||
+        ((tile->flags & CACHE_INSIDE) && f->max_iter > tile->max_iter) ||
+        ((tile->flags & CACHE_CLAMPED) && f->iter_offset < tile->iter_offset)) tile = NULL;
+  }
+  w->cache_ti[d] = ti;
+  w->cache_tj[d] = tj;
+  w->cache_tile[d] = tile;
+  return tile;
+}
+
+// Copy the sample from the cache if it has it at this level, or one level
+// finer or coarser
+static inline bool cache_pixel(FractalBuffer* f, FractalWorker* w, int16_t i, int16_t j, uint32_t index)
+{
+  int32_t gi = f->cache_base_i + i;
+  int32_t gj = f->cache_base_j + j;
+  w->cache_lookups++;
+  for (int d = 0; d < 3; ++d) {
+    int8_t level = f->cache_level;
+    int32_t si = gi, sj = gj;
+    if (d == 1) {
+      if (level == FRACTAL_CACHE_MAX_LEVEL) continue;
+      level++;
+      si = gi * 2;
+      sj = gj * 2;
+    } else if (d == 2) {
+      if (level == 0 || ((gi | gj) & 1)) continue;
+      level--;
+      si = gi >> 1;
+      sj = gj >> 1;
+    }
+    const FractalCacheTile* tile = cache_tile(f, w, d, level, si >> 3, sj >> 3);
+    if (!tile) continue;
+
+    uint16_t v = tile->values[((si & 7) << 3) | (sj & 7)];
+    store_iter(f, w, v ? MIN(f->max_iter, v + tile->iter_offset) : f->max_iter, index);
+    w->cache_hits++;
+    return true;
+  }
+  return false;
+}
+
+// Generate a pixel with the kernel for formula, precision and check, which
+// are constants in each of the kernels below
+static inline __attribute__((always_inline))
+void generate_pixel_with(FractalBuffer* f, FractalWorker* w, int16_t i, int16_t j, uint32_t index,
+                         fractal_formula_t formula, fractal_precision_t precision, interior_check_t check,
+                         bool perturbed)
+{
+  w->pixels++;
+  if (f->reuse_ratio && reuse_pixel(f, w, i, j, index)) return;
+  if (f->cache_level >= 0 && cache_pixel(f, w, i, j, index)) return;
+
+  const bool mandelbrot = formula == FRACTAL_FORMULA_MANDELBROT;
+  const bool julia = formula == FRACTAL_FORMULA_JULIA;
+  uint16_t k;
+  uint8_t smooth = 0;
+  if (perturbed) {
+    k = generate_one_perturbed(f, w, i, j);
+    w->iterations += k;
+  } else if (precision == FRACTAL_PRECISION_Q4_60 || precision == FRACTAL_PRECISION_Q4_28) {
+    fixed60_t x0 = f->lminx + j * f->lincx;
+    fixed60_t y0 = f->lminy + i * f->lincy;
+    if (mandelbrot && f->check_bulbs && in_main_bulbs60(x0, y0)) k = f->max_iter;
+    else {
+      if (precision == FRACTAL_PRECISION_Q4_60) k = generate_one_q4_60(f, x0, y0);
+      else if (julia) k = generate_one_q4_28(f, formula, x0 >> 32, y0 >> 32, f->ljulia_x >> 32, f->ljulia_y >> 32);
+      else k = generate_one_q4_28(f, formula, x0 >> 32, y0 >> 32, x0 >> 32, y0 >> 32);
+      w->iterations += k;
+    }
   } else {
-    if (k > f->iter_offset) k -= f->iter_offset;
-    else k = 1;
-    *buffptr = k;
-    if (f->min_iter > k) f->min_iter = k;
+    fixed_pt_t x0 = f->iminx + j * f->incx;
+    fixed_pt_t y0 = f->iminy + i * f->incy;
+    fixed_pt_t cx = julia ? f->julia_x : x0;
+    fixed_pt_t cy = julia ? f->julia_y : y0;
+    fixed_pt_t x, y;  // Where the orbit escaped
+    if (mandelbrot && f->check_bulbs && in_main_bulbs(x0, y0)) k = f->max_iter;
+    else {
+      if (check == CHECK_DERIVATIVE) k = generate_one_derivative_check(f, w, x0, y0, cx, cy, &x, &y);
+      else if (check == CHECK_CYCLE) k = generate_one_cycle_check(f, w, formula, x0, y0, cx, cy, &x, &y);
+      else k = generate_one(f, formula, x0, y0, cx, cy, &x, &y);
+      w->iterations += k;
+      if (f->smooth && k < f->max_iter) smooth = smooth_escape(f, formula, &k, x, y, cx, cy);
+    }
   }
+  store_iter(f, w, k, index);
+  if (f->smooth) f->smooth[index] = smooth;
 }
 
-void generate_fractal(FractalBuffer* f)
+#define PIXEL_KERNEL(name, formula, precision, check, perturbed) \
+  static void name(FractalBuffer* f, FractalWorker* w, int16_t i, int16_t j, uint32_t index) \
+  { generate_pixel_with(f, w, i, j, index, formula, precision, check, perturbed); }
+
+#define FORMULA_KERNELS(prefix, formula) \
+  PIXEL_KERNEL(prefix##_q6_26, formula, FRACTAL_PRECISION_Q6_26, CHECK_NONE, false) \
+  PIXEL_KERNEL(prefix##_q6_26_cycle, formula, FRACTAL_PRECISION_Q6_26, CHECK_CYCLE, false) \
+  PIXEL_KERNEL(prefix##_q4_28, formula, FRACTAL_PRECISION_Q4_28, CHECK_NONE, false)
+
+FORMULA_KERNELS(mandelbrot, FRACTAL_FORMULA_MANDELBROT)
+FORMULA_KERNELS(julia, FRACTAL_FORMULA_JULIA)
+FORMULA_KERNELS(burning_ship, FRACTAL_FORMULA_BURNING_SHIP)
+FORMULA_KERNELS(multibrot3, FRACTAL_FORMULA_MULTIBROT3)
+PIXEL_KERNEL(mandelbrot_q6_26_derivative, FRACTAL_FORMULA_MANDELBROT, FRACTAL_PRECISION_Q6_26, CHECK_DERIVATIVE, false)
+PIXEL_KERNEL(julia_q6_26_derivative, FRACTAL_FORMULA_JULIA, FRACTAL_PRECISION_Q6_26, CHECK_DERIVATIVE, false)
+PIXEL_KERNEL(mandelbrot_q4_60, FRACTAL_FORMULA_MANDELBROT, FRACTAL_PRECISION_Q4_60, CHECK_NONE, false)
+PIXEL_KERNEL(mandelbrot_perturbed, FRACTAL_FORMULA_MANDELBROT, FRACTAL_PRECISION_AUTO, CHECK_NONE, true)
+
+// Q6.26 kernels by formula and interior check.  The derivative check is
+// only for z^2 + c, so the other formulas fall back to the cycle check.
+static const fractal_kernel_t q6_26_kernels[FRACTAL_FORMULAS][3] = {
+  { mandelbrot_q6_26, mandelbrot_q6_26_cycle, mandelbrot_q6_26_derivative },
+  { julia_q6_26, julia_q6_26_cycle, julia_q6_26_derivative },
+  { burning_ship_q6_26, burning_ship_q6_26_cycle, burning_ship_q6_26_cycle },
+  { multibrot3_q6_26, multibrot3_q6_26_cycle, multibrot3_q6_26_cycle },
+};
+
+static const fractal_kernel_t q4_28_kernels[FRACTAL_FORMULAS] = {
+  mandelbrot_q4_28, julia_q4_28, burning_ship_q4_28, multibrot3_q4_28,
+};
+
+static fractal_kernel_t choose_kernel(const FractalBuffer* f)
+{
+  if (f->use_perturbation && f->formula == FRACTAL_FORMULA_MANDELBROT) return mandelbrot_perturbed;
+  if (f->active_precision == FRACTAL_PRECISION_Q4_60) return mandelbrot_q4_60;
+  if (f->active_precision == FRACTAL_PRECISION_Q4_28) return q4_28_kernels[f->formula];
+  interior_check_t check = f->use_derivative_check ? CHECK_DERIVATIVE : f->use_cycle_check ? CHECK_CYCLE : CHECK_NONE;
+  return q6_26_kernels[f->formula][check];
+}
+
+// Set pixels j0 to j1 - 1 of row i
+static void fill_row(FractalBuffer* f, int16_t i, int16_t j0, int16_t j1, uint16_t value)
+{
+  if (f->smooth) {
+    for (int16_t j = j0; j < j1; ++j) f->smooth[fractal_pixel_index(f, i, j)] = 0;
+  }
+
+  if (f->iter16) {
+    for (int16_t j = j0; j < j1; ++j) fractal_set_pixel(f, fractal_pixel_index(f, i, j), value);
+    return;
+  }
+
+  if (f->layout != FRACTAL_LAYOUT_TILED) {
+    memset(f->buff + fractal_pixel_index(f, i, j0), value, j1 - j0);
+    return;
+  }
+
+  // A row is contiguous within each tile
+  while (j0 < j1) {
+    int16_t end = MIN(j1, (j0 + 8) & ~7);
+    memset(f->buff + fractal_pixel_index(f, i, j0), value, end - j0);
+    j0 = end;
+  }
+}
+
+// Increment a counter shared between workers, returning its old value.
+// The RP2040 has no atomic read-modify-write instructions, so the hardware
+// spin lock is used there.
+static inline uint16_t atomic_fetch_inc(volatile uint16_t* counter)
+{
+#if PICO_ON_DEVICE
+  uint32_t save = spin_lock_blocking(mandel_lock);
+  uint16_t value = (*counter)++;
+  spin_unlock(mandel_lock, save);
+  return value;
+#else
+  return __atomic_fetch_add(counter, 1, __ATOMIC_ACQ_REL);
+#endif
+}
+
+static inline void ms_push(FractalWorker* w, int16_t i0, int16_t j0, int16_t i1, int16_t j1, uint8_t phase)
+{
+  MSRect* r = &w->stack[w->depth++];
+  r->i0 = i0;
+  r->j0 = j0;
+  r->i1 = i1;
+  r->j1 = j1;
+  r->phase = phase;
+  r->pos = 0;
+}
+
+// Adam7 interlacing: where each pass starts within an 8x8 block, and its step
+static const uint8_t pass_start_i[FRACTAL_PASSES] = { 0, 0, 4, 0, 2, 0, 1 };
+static const uint8_t pass_start_j[FRACTAL_PASSES] = { 0, 4, 0, 2, 0, 1, 0 };
+static const uint8_t pass_step_i[FRACTAL_PASSES] = { 8, 8, 8, 4, 4, 2, 2 };
+static const uint8_t pass_step_j[FRACTAL_PASSES] = { 8, 8, 4, 4, 2, 2, 1 };
+
+// Whether the next tile starts a band of an encoded buffer and every slot
+// of the ring is taken.  Checked without the lock, so it's only a hint.
+static inline bool rle_ring_full(const FractalBuffer* f)
+{
+  uint16_t t = f->tile_next;
+  if (f->layout != FRACTAL_LAYOUT_RLE || t >= f->num_tiles || t % f->tiles_x != 0) return false;
+  for (int slot = 0; slot < FRACTAL_RLE_RING_BANDS; ++slot) {
+    if (f->slot_band[slot] < 0) return false;
+  }
+  return true;
+}
+
+// Claim the next tile from the queue for a worker.
+// Returns false if there are none left.
+static bool claim_tile(FractalBuffer* f, FractalWorker* w)
 {
-  uint8_t* buffptr = f->buff;
+  // Check first so that idle workers polling the queue can't wrap the counter
+  if (f->tile_next >= f->num_tiles) return false;
+  uint16_t t;
+  if (f->layout == FRACTAL_LAYOUT_RLE) {
+    // The first tile of a band can only be claimed once a slot is free,
+    // so don't take the lock from the worker freeing one until then
+    if (rle_ring_full(f)) return false;
+    uint32_t save = spin_lock_blocking(mandel_lock);
+    t = f->tile_next;
+    if (t < f->num_tiles && t % f->tiles_x == 0) {
+      int slot = 0;
+      while (slot < FRACTAL_RLE_RING_BANDS && f->slot_band[slot] >= 0) ++slot;
+      if (slot < FRACTAL_RLE_RING_BANDS) {
+        int16_t band = t / f->tiles_x;
+        f->slot_band[slot] = band;
+        f->slot_tiles_done[slot] = 0;
+        f->band_slot[band] = slot;
+      } else {
+        t = f->num_tiles;
+      }
+    }
+    if (t < f->num_tiles) f->tile_next = t + 1;
+    spin_unlock(mandel_lock, save);
+  } else {
+    t = atomic_fetch_inc(&f->tile_next);
+  }
+  if (t >= f->num_tiles) return false;
 
-  fixed_pt_t y0 = f->iminy;
-  int16_t i = 0;
-  for (; i < f->iend; ++i, y0 += f->incy) {
-    fixed_pt_t x0 = f->iminx;
-    for (int16_t j = 0; j < f->cols; ++j, x0 += f->incx) {
-      if (f->use_cycle_check) generate_one_cycle_check(f, x0, y0, buffptr++);
-      else generate_one(f, x0, y0, buffptr++);
+  w->tile = t;
+  if (f->mode == FRACTAL_MODE_PROGRESSIVE) {
+    int8_t pass = t / f->tiles_y;
+    w->pass = pass;
+    w->i0 = (t % f->tiles_y) * PASS_BAND;
+    w->i1 = MIN(f->rows, w->i0 + PASS_BAND);
+    w->j0 = 0;
+    w->j1 = f->cols;
+    w->i = w->i0 + pass_start_i[pass];
+    w->jstart = pass_start_j[pass];
+    w->di = pass_step_i[pass];
+    w->dj = pass_step_j[pass];
+  } else {
+    int16_t ti = t / f->tiles_x;
+    int16_t tj = t % f->tiles_x;
+    if (f->layout == FRACTAL_LAYOUT_RLE) {
+      w->i0 = ti * FRACTAL_RLE_BAND_ROWS;
+      w->i1 = MIN(f->rows, w->i0 + FRACTAL_RLE_BAND_ROWS);
+    } else {
+      w->i0 = ti * f->rows / f->tiles_y;
+      w->i1 = (ti + 1) * f->rows / f->tiles_y;
     }
+    w->j0 = tj * f->cols / f->tiles_x;
+    w->j1 = (tj + 1) * f->cols / f->tiles_x;
+    w->i = w->i0;
+    w->jstart = w->j0;
+    w->di = 1;
+    w->dj = 1;
+  }
+  w->j = w->jstart;
+  if (f->mode == FRACTAL_MODE_MARIANI_SILVER) {
+    ms_push(w, w->i0, w->j0, w->i1 - 1, w->j1 - 1, MS_BORDER);
   }
+  return true;
+}
 
-  fixed_pt_t x0 = f->iminx;
-  for (int16_t j = 0; j < f->jend && i == f->iend; ++j, x0 += f->incx) {
-    if (f->use_cycle_check) generate_one_cycle_check(f, x0, y0, buffptr++);
-    else generate_one(f, x0, y0, buffptr++);
+// Encode samples of row, each the first of 1 << shift pixels, into at most
+// size bytes at out.  Returns the bytes written, or 0 if they don't fit.
+static uint32_t rle_encode(const uint8_t* row, int16_t cols, uint8_t shift, uint8_t* out, uint32_t size)
+{
+  int16_t samples = (cols + (1 << shift) - 1) >> shift;
+  uint32_t n = 0;
+  if (size < 1) return 0;
+  out[n++] = shift;
+
+  int16_t s = 0;
+  while (s < samples) {
+    uint8_t v = row[s << shift];
+    int16_t run = 1;
+    while (s + run < samples && run < 130 && row[(s + run) << shift] == v) ++run;
+    if (run >= 3) {
+      if (n + 2 > size) return 0;
+      out[n++] = run + 125;
+      out[n++] = v;
+      s += run;
+      continue;
+    }
+
+    // Literals up to the next run of 3
+    int16_t count = 1;
+    while (s + count < samples && count < 128) {
+      int16_t t = s + count;
+      if (t + 2 < samples && row[t << shift] == row[(t + 1) << shift] && row[t << shift] == row[(t + 2) << shift]) break;
+      ++count;
+    }
+    if (n + 1 + count > size) return 0;
+    out[n++] = count - 1;
+    for (int16_t k = 0; k < count; ++k) out[n++] = row[(s + k) << shift];
+    s += count;
   }
+  return n;
+}
 
-  f->done = true;
+// Encode row i from the ring, at the highest resolution that leaves space
+// for the remaining rows at the lowest
+static void encode_row(FractalBuffer* f, int16_t i)
+{
+  const int16_t min_samples = (f->cols + (1 << FRACTAL_RLE_MAX_SHIFT) - 1) >> FRACTAL_RLE_MAX_SHIFT;
+  uint32_t reserve = (f->rows - ++f->rows_encoded) * FRACTAL_RLE_ROW_BYTES(min_samples);
+  uint32_t space = f->rle_size - f->rle_used - reserve;
+  const uint8_t* row = fractal_pixel_ptr(f, i, 0);
+  uint32_t n = 0;
+  for (uint8_t shift = 0; n == 0 && shift <= FRACTAL_RLE_MAX_SHIFT; ++shift) {
+    n = rle_encode(row, f->cols, shift, f->rle_data + f->rle_used, space);
+    if (n && shift) f->rle_reduced_rows++;
+  }
+  f->rle_rows[i] = f->rle_used;
+  f->rle_used += n;
 }
 
-void generate_steal(FractalBuffer* f, uint dma_to_check)
+// Encode bands that are done, in any order, and free their slots.  One
+// worker encodes at a time, carrying on with any bands finished by the
+// others meanwhile, and sets done after the last band.
+static void encode_bands(FractalBuffer* f)
 {
-  if (!dma_channel_is_busy(dma_to_check)) return;
-  if (f->done) {
-    dma_channel_wait_for_finish_blocking(dma_to_check);
+  uint32_t save = spin_lock_blocking(mandel_lock);
+  if (f->encoding) {
+    spin_unlock(mandel_lock, save);
     return;
   }
+  f->encoding = true;
+  for (int slot = 0; slot < FRACTAL_RLE_RING_BANDS; ++slot) {
+    if (f->slot_band[slot] < 0 || f->slot_tiles_done[slot] < f->tiles_x) continue;
+    int16_t band = f->slot_band[slot];
+    spin_unlock(mandel_lock, save);
+
+    int16_t i1 = MIN(f->rows, (band + 1) * FRACTAL_RLE_BAND_ROWS);
+    for (int16_t i = band * FRACTAL_RLE_BAND_ROWS; i < i1; ++i) encode_row(f, i);
+
+    save = spin_lock_blocking(mandel_lock);
+    f->slot_band[slot] = -1;
+    f->bands_encoded++;
+
+    // Start again, as others may have finished bands in earlier slots
+    slot = -1;
+  }
+  f->encoding = false;
+  if (f->bands_encoded == f->tiles_y) f->done = true;
+  spin_unlock(mandel_lock, save);
 
-  uint8_t* buffptr = f->buff + f->iend * f->cols + f->jend;
+  // Wake any workers waiting for a free slot
+  __sev();
+}
 
-  fixed_pt_t y0 = f->iminy + f->iend * f->incy;
-  fixed_pt_t x0 = f->iminx + f->jend * f->incx;
-  for (; f->iend >= 0; --f->iend, y0 -= f->incy) {
-    for (; f->jend >= 0; x0 -= f->incx) {
-      if (f->use_cycle_check) generate_one_cycle_check(f, x0, y0, buffptr--);
-      else generate_one(f, x0, y0, buffptr--);
+void fractal_rle_row(const FractalBuffer* f, int16_t i, uint8_t* row)
+{
+  const uint8_t* p = f->rle_data + f->rle_rows[i];
+  uint8_t shift = *p++;
+  int16_t samples = (f->cols + (1 << shift) - 1) >> shift;
 
-      --f->jend;
-      if (!dma_channel_is_busy(dma_to_check)) return;
+  // Decode the samples to the start of row, then spread them out from the end
+  int16_t s = 0;
+  while (s < samples) {
+    uint8_t c = *p++;
+    if (c < 128) {
+      memcpy(row + s, p, c + 1);
+      p += c + 1;
+      s += c + 1;
+    } else {
+      memset(row + s, *p++, c - 125);
+      s += c - 125;
     }
-    f->jend = f->cols - 1;
-    x0 = f->imaxx - f->incx;
   }
+  if (shift == 0) return;
+  for (s = samples - 1; s >= 0; --s) {
+    int16_t j0 = s << shift;
+    memset(row + j0, row[s], MIN(f->cols, j0 + (1 << shift)) - j0);
+  }
+}
 
-  dma_channel_wait_for_finish_blocking(dma_to_check);
+// Fold the worker's stats for its finished tile into the buffer.  Whoever
+// finishes the last tile sets done, so done is only set once every pixel
+// has been written.  Encoded buffers are done once the last band is encoded.
+static void finish_tile(FractalBuffer* f, FractalWorker* w)
+{
+  bool rle = f->layout == FRACTAL_LAYOUT_RLE;
+  uint32_t save = spin_lock_blocking(mandel_lock);
+  if (rle) f->slot_tiles_done[f->band_slot[w->tile / f->tiles_x]]++;
+  f->count_inside += w->count_inside;
+  if (f->min_iter > w->min_iter) f->min_iter = w->min_iter;
+  f->reuse_count += w->reuse_count;
+  f->glitch_count += w->glitch_count;
+  f->cycle_count += w->cycle_count;
+  f->cycle_iters_saved += w->cycle_iters_saved;
+  f->iterations += w->iterations;
+  f->cache_lookups += w->cache_lookups;
+  f->cache_hits += w->cache_hits;
+  for (int b = 0; b < FRACTAL_HISTOGRAM_BINS; ++b) f->histogram[b] += w->histogram[b];
+  if (f->mode == FRACTAL_MODE_PROGRESSIVE) {
+    f->pass_tiles_done[w->pass]++;
+    uint8_t passes = f->passes_done;
+    while (passes < FRACTAL_PASSES && f->pass_tiles_done[passes] == f->tiles_y) ++passes;
+    f->passes_done = passes;
+  }
+  if (++f->tiles_done == f->num_tiles && !rle) {
+    f->passes_done = FRACTAL_PASSES;
+    f->done = true;
+  }
+  spin_unlock(mandel_lock, save);
+
+  w->count_inside = 0;
+  w->min_iter = UINT16_MAX;
+  w->reuse_count = 0;
+  w->glitch_count = 0;
+  w->cycle_count = 0;
+  w->cycle_iters_saved = 0;
+  w->iterations = 0;
+  w->cache_lookups = 0;
+  w->cache_hits = 0;
+  memset(w->histogram, 0, sizeof(w->histogram));
+  w->tile = -1;
+
+  if (rle) encode_bands(f);
 }
 
-void generate_steal_until_done(FractalBuffer* f)
+static bool ms_border_uniform(FractalBuffer* f, const MSRect* r, uint16_t* value)
+{
+  uint16_t v = fractal_pixel(f, r->i0, r->j0);
+  for (int16_t j = r->j0; j <= r->j1; ++j) {
+    if (fractal_pixel(f, r->i0, j) != v || fractal_pixel(f, r->i1, j) != v) return false;
+  }
+  for (int16_t i = r->i0 + 1; i < r->i1; ++i) {
+    if (fractal_pixel(f, i, r->j0) != v || fractal_pixel(f, i, r->j1) != v) return false;
+  }
+  *value = v;
+  return true;
+}
+
+static void ms_fill(FractalBuffer* f, FractalWorker* w, const MSRect* r, uint16_t value)
+{
+  for (int16_t i = r->i0 + 1; i < r->i1; ++i) {
+    fill_row(f, i, r->j0 + 1, r->j1, value);
+  }
+  uint32_t area = (r->i1 - r->i0 - 1) * (r->j1 - r->j0 - 1);
+  if (value == 0) w->count_inside += area;
+  w->histogram[value >> f->histogram_shift] += area;
+}
+
+// Do one step of Mariani-Silver subdivision of the worker's tile: generate
+// one pixel, or check, fill or split one rectangle.  The tile's border is
+// generated first.  If it is uniform the tile is filled, otherwise the
+// cross through its middle is generated and the four quarters, whose
+// borders are now all known, are processed the same way.
+static void ms_step(FractalBuffer* f, FractalWorker* w)
+{
+  MSRect* r = &w->stack[w->depth - 1];
+  int16_t width = r->j1 - r->j0 + 1;
+  int16_t height = r->i1 - r->i0 + 1;
+  int16_t i, j;
+  switch (r->phase) {
+    case MS_BORDER:
+      if (r->pos < width) {
+        i = r->i0;
+        j = r->j0 + r->pos;
+      } else if (r->pos < 2 * width) {
+        i = r->i1;
+        j = r->j0 + r->pos - width;
+      } else {
+        int16_t p = r->pos - 2 * width;
+        i = r->i0 + 1 + (p >> 1);
+        j = (p & 1) ? r->j1 : r->j0;
+      }
+      f->kernel(f, w, i, j, fractal_pixel_index(f, i, j));
+      if (++r->pos == 2 * width + 2 * (height - 2)) r->phase = MS_CHECK;
+      break;
+
+    case MS_CHECK: {
+      uint16_t value;
+      if (width <= 2 || height <= 2) {
+        --w->depth;
+      } else if (ms_border_uniform(f, r, &value) && (value == 0 || !f->smooth)) {
+        ms_fill(f, w, r, value);
+        --w->depth;
+      } else if (width - 2 <= MS_MIN_SIZE || height - 2 <= MS_MIN_SIZE) {
+        r->phase = MS_INTERIOR;
+        r->pos = 0;
+      } else {
+        r->phase = MS_SPLIT;
+        r->pos = 0;
+      }
+      break;
+    }
+
+    case MS_INTERIOR:
+      i = r->i0 + 1 + r->pos / (width - 2);
+      j = r->j0 + 1 + r->pos % (width - 2);
+      f->kernel(f, w, i, j, fractal_pixel_index(f, i, j));
+      if (++r->pos == (width - 2) * (height - 2)) --w->depth;
+      break;
+
+    case MS_SPLIT: {
+      int16_t im = (r->i0 + r->i1) >> 1;
+      int16_t jm = (r->j0 + r->j1) >> 1;
+      if (r->pos < width - 2) {
+        i = im;
+        j = r->j0 + 1 + r->pos;
+      } else {
+        i = r->i0 + 1 + r->pos - (width - 2);
+        if (i >= im) ++i;
+        j = jm;
+      }
+      f->kernel(f, w, i, j, fractal_pixel_index(f, i, j));
+      if (++r->pos == (width - 2) + (height - 3)) {
+        MSRect parent = *r;
+        --w->depth;
+        ms_push(w, parent.i0, parent.j0, im, jm, MS_CHECK);
+        ms_push(w, parent.i0, jm, im, parent.j1, MS_CHECK);
+        ms_push(w, im, parent.j0, parent.i1, jm, MS_CHECK);
+        ms_push(w, im, jm, parent.i1, parent.j1, MS_CHECK);
+      }
+      break;
+    }
+  }
+}
+
+// Do one step of work: generate one pixel of the worker's tile, or for
+// Mariani-Silver possibly check, fill or split a rectangle instead.
+// Returns false once the worker has no tile and there are none left.
+static bool generate_step(FractalBuffer* f, FractalWorker* w)
 {
-  uint8_t* buffptr = f->buff + f->iend * f->cols + f->jend;
+  if (w->tile < 0 && !claim_tile(f, w)) return false;
+
+  if (f->mode == FRACTAL_MODE_MARIANI_SILVER) {
+    ms_step(f, w);
+    if (w->depth == 0) finish_tile(f, w);
+  } else if (w->i >= w->i1 || w->jstart >= w->j1) {
+    // No pixels of this pass in the tile
+    finish_tile(f, w);
+  } else {
+    f->kernel(f, w, w->i, w->j, fractal_pixel_index(f, w->i, w->j));
+    w->j += w->dj;
+    if (w->j >= w->j1) {
+      w->j = w->jstart;
+      w->i += w->di;
+      if (w->i >= w->i1) finish_tile(f, w);
+    }
+  }
+  return true;
+}
+
+#if FRACTAL_SIMD
+// Whether the host SIMD kernel gives the same result as the scalar kernel
+static inline bool use_simd(const FractalBuffer* f)
+{
+  return mandel_simd_enabled && f->formula == FRACTAL_FORMULA_MANDELBROT && !f->use_perturbation && !f->reuse_ratio && f->cache_level < 0 && !f->smooth &&
+         !f->use_cycle_check && !f->use_derivative_check && f->active_precision == FRACTAL_PRECISION_Q6_26;
+}
+
+static void flush_simd(FractalBuffer* f, FractalWorker* w, int16_t i, const int32_t* x0, const int32_t* y0,
+                       const int16_t* cols, int n)
+{
+  uint16_t iters[MANDEL_SIMD_BATCH];
+  mandel_simd_iterate(x0, y0, n, f->max_iter, iters);
+  for (int p = 0; p < n; ++p) {
+    w->iterations += iters[p];
+    store_iter(f, w, iters[p], fractal_pixel_index(f, i, cols[p]));
+  }
+}
+
+// Generate pixels j0, j0 + dj, ... before j1 of row i, passing the pixels
+// outside the main bulbs to the SIMD kernel in batches
+static void generate_row_simd(FractalBuffer* f, FractalWorker* w, int16_t i, int16_t j0, int16_t j1, int16_t dj)
+{
+  int32_t x0[MANDEL_SIMD_BATCH], y0[MANDEL_SIMD_BATCH];
+  int16_t cols[MANDEL_SIMD_BATCH];
+  fixed_pt_t y = f->iminy + i * f->incy;
+
+  int n = 0;
+  for (int16_t j = j0; j < j1; j += dj) {
+    fixed_pt_t x = f->iminx + j * f->incx;
+    w->pixels++;
+    if (f->check_bulbs && in_main_bulbs(x, y)) {
+      store_iter(f, w, f->max_iter, fractal_pixel_index(f, i, j));
+      continue;
+    }
+    x0[n] = x;
+    y0[n] = y;
+    cols[n++] = j;
+
+    if (n == MANDEL_SIMD_BATCH) {
+      flush_simd(f, w, i, x0, y0, cols, n);
+      n = 0;
+    }
+  }
+  if (n) flush_simd(f, w, i, x0, y0, cols, n);
+}
+#endif
 
-  fixed_pt_t y0 = f->iminy + f->iend * f->incy;
-  fixed_pt_t x0 = f->iminx + f->jend * f->incx;
-  for (; f->iend >= 0; --f->iend, y0 -= f->incy) {
-    for (; f->jend >= 0; --f->jend, x0 -= f->incx) {
-      if (f->use_cycle_check) generate_one_cycle_check(f, x0, y0, buffptr--);
-      else generate_one(f, x0, y0, buffptr--);
+// Finish the worker's tile and then claim and generate tiles until the
+// queue is empty.
+static void generate_until_empty(FractalBuffer* f, FractalWorker* w)
+{
+  while (w->tile >= 0 || claim_tile(f, w) || f->tile_next < f->num_tiles) {
+    // Tiles of an encoded buffer wait for a band of the ring to be free,
+    // which encode_bands signals
+    if (w->tile < 0) {
+      while (rle_ring_full(f)) __wfe();
+      continue;
+    }
 
-      if (f->done) return;
+    if (f->mode == FRACTAL_MODE_MARIANI_SILVER) {
+      while (w->depth) ms_step(f, w);
+    } else {
+      int16_t j0 = w->j;
+      for (int16_t i = w->i; i < w->i1; i += w->di, j0 = w->jstart) {
+#if FRACTAL_SIMD
+        if (use_simd(f)) {
+          generate_row_simd(f, w, i, j0, w->j1, w->dj);
+          continue;
+        }
+#endif
+        if (f->layout != FRACTAL_LAYOUT_TILED && w->dj == 1) {
+          uint32_t index = fractal_pixel_index(f, i, j0);
+          for (int16_t j = j0; j < w->j1; ++j) {
+            f->kernel(f, w, i, j, index++);
+          }
+        } else {
+          for (int16_t j = j0; j < w->j1; j += w->dj) {
+            f->kernel(f, w, i, j, fractal_pixel_index(f, i, j));
+          }
+        }
+      }
     }
-    f->jend = f->cols - 1;
-    x0 = f->imaxx - f->incx;
+    finish_tile(f, w);
   }
 }
+
+void generate_worker(FractalBuffer* f, int worker)
+{
+  generate_until_empty(f, &f->workers[worker]);
+}
+
+void generate_fractal(FractalBuffer* f)
+{
+  generate_until_empty(f, &f->workers[0]);
+}
+
+void generate_steal(FractalBuffer* f, DisplayBackend* display, uint chan_idx)
+{
+  if (!display->is_busy(display, chan_idx)) {
+    f->steal_idle++;
+    return;
+  }
+
+  FractalWorker* w = &f->workers[1];
+  while (generate_step(f, w)) {
+    if (!display->is_busy(display, chan_idx)) return;
+  }
+
+  uint32_t start = time_us_32();
+  display->wait_for_finish(display, chan_idx);
+  f->dma_stall_us += time_us_32() - start;
+}
+
+void generate_steal_until_done(FractalBuffer* f)
+{
+  generate_until_empty(f, &f->workers[1]);
+}
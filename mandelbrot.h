@@ -5,28 +5,364 @@ void mandel_init();
 // Range [-32,32) with precision 2^-26
 typedef int32_t fixed_pt_t;
 
+// Generation kernels, in increasing order of cost.
+typedef enum {
+  FRACTAL_PRECISION_AUTO,   // Cheapest kernel that is precise enough for the view
+  FRACTAL_PRECISION_Q6_26,  // fixed_pt_t with truncated multiplies
+  FRACTAL_PRECISION_Q4_28,  // 32-bit fixed point with exact 32x32->64 multiplies
+  FRACTAL_PRECISION_Q4_60,  // Double word fixed point
+} fractal_precision_t;
+
+// Formula iterated for each pixel.  Only the Mandelbrot set is generated by
+// the Q4.60 kernel, perturbation, the tile cache and the host SIMD kernel,
+// and other formulas use the next kernel down or skip the rest.
+typedef enum {
+  FRACTAL_FORMULA_MANDELBROT,    // z^2 + c, with z starting at 0 and c the pixel
+  FRACTAL_FORMULA_JULIA,         // z^2 + c, with z starting at the pixel and c fixed
+  FRACTAL_FORMULA_BURNING_SHIP,  // (|x| + i|y|)^2 + c
+  FRACTAL_FORMULA_MULTIBROT3,    // z^3 + c
+  FRACTAL_FORMULAS
+} fractal_formula_t;
+
+// Order in which pixels are generated
+typedef enum {
+  FRACTAL_MODE_RASTER,          // Iterate every pixel
+  FRACTAL_MODE_MARIANI_SILVER,  // Fill rectangles with uniform borders without iterating them
+  FRACTAL_MODE_PROGRESSIVE,     // Iterate every pixel in Adam7 interlaced passes, coarse to fine
+} fractal_mode_t;
+
+// Number of passes of FRACTAL_MODE_PROGRESSIVE.  passes_done reaches this
+// once generation is done in every mode, except FRACTAL_LAYOUT_RLE where it
+// stays 0.
+#define FRACTAL_PASSES 7
+
+// Arrangement of pixels in buff
+typedef enum {
+  FRACTAL_LAYOUT_ROW_MAJOR,  // buff[i * cols + j]
+  FRACTAL_LAYOUT_TILED,      // Row major 8x8 tiles, stored in row major order
+  FRACTAL_LAYOUT_RLE,        // Run-length encoded rows in rle_data, see below
+} fractal_layout_t;
+
+// Pixels needed in buff for FRACTAL_LAYOUT_TILED, which pads to whole tiles.
+// Buffers with iter16 set need two bytes per pixel.
+#define FRACTAL_TILED_BUFFER_SIZE(rows, cols) ((((rows) + 7) & ~7) * (((cols) + 7) & ~7))
+
+// FRACTAL_LAYOUT_RLE generates in bands of FRACTAL_RLE_BAND_ROWS rows, each
+// in a slot of a ring in buff while it is generated, and encodes each band
+// into rle_data once it is done.  A worker that is slow to finish a tile
+// only holds up its own band's slot, so there is a slot for each worker and
+// one for the band being claimed.  Images have up to FRACTAL_RLE_MAX_BANDS
+// bands.
+#define FRACTAL_RLE_BAND_ROWS 16
+#define FRACTAL_RLE_RING_BANDS 3
+#define FRACTAL_RLE_MAX_BANDS 64
+#define FRACTAL_RLE_RING_SIZE(cols) (FRACTAL_RLE_RING_BANDS * FRACTAL_RLE_BAND_ROWS * (cols))
+
+// A row that doesn't fit in what is left of rle_data is stored at a half or
+// a quarter of the horizontal resolution.  Each row is a shift byte, then
+// tokens: c < 128 is followed by c + 1 literal samples, and c >= 128 by a
+// sample repeated c - 125 times.  rle_size must be at least
+// FRACTAL_RLE_MIN_SIZE so that every row fits at the lowest resolution.
+#define FRACTAL_RLE_MAX_SHIFT 2
+#define FRACTAL_RLE_ROW_BYTES(samples) (1 + (samples) + ((samples) + 127) / 128)
+#define FRACTAL_RLE_MIN_SIZE(rows, cols) \
+  ((rows) * FRACTAL_RLE_ROW_BYTES(((cols) + (1 << FRACTAL_RLE_MAX_SHIFT) - 1) >> FRACTAL_RLE_MAX_SHIFT))
+
+// Number of workers that can generate a buffer concurrently.  Core 1 is
+// worker 0 and core 0 is worker 1.
+#ifndef FRACTAL_MAX_WORKERS
+#define FRACTAL_MAX_WORKERS 2
+#endif
+
+// Perturbation deltas are floats, which the Pico iterates much faster than
+// doubles.  The host builds them as doubles, which keeps perturbation
+// within a few pixels in 10000 of the exact result at any depth.
+#ifndef FRACTAL_PERT_DOUBLE
+#define FRACTAL_PERT_DOUBLE 0
+#endif
+#if FRACTAL_PERT_DOUBLE
+typedef double pert_float_t;
+#else
+typedef float pert_float_t;
+#endif
+
+// Mariani-Silver rectangles are inclusive of their border.
+#define MS_STACK_SIZE 24
+
+// Bins of the histogram of pixel values built during generation
+#define FRACTAL_HISTOGRAM_BINS 256
+
 typedef struct {
+  int16_t i0, j0, i1, j1;
+  uint8_t phase;
+  int16_t pos;
+} MSRect;
+
+// Tile cache.  Views snapped by fractal_cache_snap_viewport have a pixel
+// step of FRACTAL_CACHE_STEP0 >> level, and pixels on a grid of multiples
+// of the step, so the same sample has the same grid position in any view
+// at that level, and twice it one level finer.  Generated buffers are
+// stored in 8x8 tiles of that grid, and generation copies samples from any
+// cached tile at the same level or one level either side instead of
+// iterating them.
+#define FRACTAL_CACHE_TILE_SIZE 8
+#define FRACTAL_CACHE_STEP0 (1 << 20)  // 1/64
+#define FRACTAL_CACHE_MAX_LEVEL 14     // Finest level the Q6.26 kernel is used for
+#define FRACTAL_CACHE_NONE 0xffff
+
+typedef struct {
+  int32_t ti, tj;         // Position in tiles on the level's grid
+  int8_t level;
+  uint8_t flags;          // Settings generated with, and whether any pixel is inside
+  uint16_t max_iter;
+  uint16_t iter_offset;   // Values are escape iteration less this, or 0 inside
+  uint16_t older, newer;  // LRU order
+  uint16_t chain;         // Next tile in the same hash bucket
+  uint8_t values[FRACTAL_CACHE_TILE_SIZE * FRACTAL_CACHE_TILE_SIZE];
+} FractalCacheTile;
+
+typedef struct {
+  // Arena and hash buckets provided by the caller, see fractal_cache_init
+  FractalCacheTile* tiles;
+  uint16_t num_tiles;
+  uint16_t* buckets;
+  uint16_t bucket_mask;
+
+  uint16_t tiles_used;
+  uint16_t newest, oldest;
+
+  // Pixels looked up and found, summed over the buffers stored, and tiles
+  // evicted to make space
+  uint32_t lookups;
+  uint32_t hits;
+  uint32_t evictions;
+} FractalCache;
+
+// Per worker generation state.  Stats are accumulated locally and merged
+// into the buffer when each tile is finished.
+typedef struct {
+  int16_t tile;  // -1 if none claimed
+  int16_t i0, j0, i1, j1;  // Tile bounds, exclusive of i1 and j1
+  int16_t i, j;  // Next pixel in raster and progressive modes
+  int16_t jstart;  // First column of each row of the tile in this pass
+  int8_t di, dj;  // Row and column step of this pass
+  int8_t pass;
+
+  // Mariani-Silver rectangles still to be done in the tile
+  MSRect stack[MS_STACK_SIZE];
+  int8_t depth;
+
+  uint32_t count_inside;
+  uint16_t min_iter;
+  uint32_t reuse_count;
+  uint32_t glitch_count;
+  uint32_t cycle_count;
+  uint32_t cycle_iters_saved;
+  uint32_t iterations;
+  uint32_t cache_lookups;
+  uint32_t cache_hits;
+  uint16_t histogram[FRACTAL_HISTOGRAM_BINS];  // A tile has fewer than 65536 pixels
+
+  // Last cache tile looked up at each of the levels searched, NULL if it
+  // wasn't usable
+  int32_t cache_ti[3], cache_tj[3];
+  const FractalCacheTile* cache_tile[3];
+
+  uint32_t pixels;  // Generated by this worker this frame
+} FractalWorker;
+
+struct FractalBuffer;
+
+// Generates pixel (i, j), stored at index
+typedef void (*fractal_kernel_t)(struct FractalBuffer* f, FractalWorker* w, int16_t i, int16_t j, uint32_t index);
+
+typedef struct FractalBuffer {
   // Configuration
   uint8_t* buff;
+  bool iter16;  // buff holds a uint16_t per pixel, 2-byte aligned
   int16_t rows;
   int16_t cols;
 
   uint16_t max_iter;
   uint16_t iter_offset;
-  float minx, miny, maxx, maxy;
+  double minx, miny, maxx, maxy;
+  fractal_precision_t precision;
+  fractal_mode_t mode;
+  fractal_layout_t layout;
+  // Interior checks, which stop iterating pixels whose orbit is found to be
+  // periodic or attracted to a cycle.  Only used by the Q6.26 kernel.
   bool use_cycle_check;
+  bool use_derivative_check;  // Instead of the cycle check, only for z^2 + c
+
+  fractal_formula_t formula;
+  double julia_cx, julia_cy;  // c for FRACTAL_FORMULA_JULIA
+
+  // Perturbation mode iterates each pixel as a pert_float_t delta from a
+  // double-double precision reference orbit, allowing zooms far beyond the
+  // precision of fixed_pt_t.  ref_orbit must have space for 2 * max_iter
+  // pert_float_t.  Only for FRACTAL_FORMULA_MANDELBROT, other formulas
+  // ignore it.
+  bool use_perturbation;
+  pert_float_t* ref_orbit;
+
+  // If set, escape counts are smoothed: buff gets the integer part of a
+  // continuous escape count for a large escape radius, and smooth the
+  // fraction in 1/256ths, indexed as buff.  Only the Q6.26 kernel smooths,
+  // and Mariani-Silver only fills blocks inside the set, as the fraction
+  // varies across escape bands.
+  uint8_t* smooth;
+
+  // Previous generation to copy coinciding samples from, or NULL.  Samples
+  // are only reused if both buffers use the Q6.26 kernel with the same
+  // settings, and the pixel step of this one divides that of the previous
+  // one exactly - see snap_fractal_viewport.
+  const struct FractalBuffer* reuse_from;
+
+  // Encoded rows for FRACTAL_LAYOUT_RLE, with rle_rows[i] the offset of row
+  // i in rle_data.  buff is then only FRACTAL_RLE_RING_SIZE(cols) bytes,
+  // and can be shared by buffers that aren't generated at the same time.
+  // Only 8-bit buffers without smooth are encoded, in raster or
+  // Mariani-Silver order, and they can't be reused or cached from.
+  uint8_t* rle_data;
+  uint32_t rle_size;
+  uint32_t* rle_rows;
+
+  // Tile cache to copy samples from, or NULL.  Only used by the Q6.26
+  // kernel without smoothing, on a view snapped by fractal_cache_snap_viewport.
+  // The cache must not change during generation.
+  FractalCache* cache;
 
   // State
   volatile bool done;
   volatile uint16_t min_iter;
   fixed_pt_t iminx, iminy, imaxx, imaxy;
   fixed_pt_t incx, incy;
+  bool check_bulbs;  // View intersects the main cardioid or period-2 bulb
+  fractal_precision_t active_precision;
+  int64_t lminx, lminy, lincx, lincy;  // Q4.60, also used for Q4.28
+  fixed_pt_t julia_x, julia_y;         // julia_cx, julia_cy in Q6.26
+  int64_t ljulia_x, ljulia_y;          // and in Q4.60
+
+  // Kernel specialised for the formula, precision and interior check,
+  // chosen by init_fractal, so that pixels don't branch on them
+  fractal_kernel_t kernel;
   volatile uint32_t count_inside;
 
-  // Tracks work stealing on core 0
-  volatile int16_t iend, jend;
+  // Iterations the kernels were run for, counting pixels stopped by an
+  // interior check as max_iter, so less cycle_iters_saved is the work done
+  volatile uint32_t iterations;
+
+  // Pixels counted by value >> histogram_shift.  The shift keeps 16-bit
+  // windows within the bins, so bin 0 holds the pixels inside the set,
+  // counted in count_inside, and any below 1 << histogram_shift that
+  // escaped.  Complete once done.
+  uint8_t histogram_shift;
+  uint32_t histogram[FRACTAL_HISTOGRAM_BINS];
+
+  // Interior check state and stats: pixels found inside by the check, and
+  // the iterations that would have been spent taking them to max_iter
+  fixed_pt_t cycle_tolerance;
+  volatile uint32_t cycle_count;
+  volatile uint32_t cycle_iters_saved;
+
+  // Perturbation state
+  double refx, refy;
+  pert_float_t pert_minx, pert_miny, pert_incx, pert_incy;
+  pert_float_t sa_coeff[6];
+  uint16_t sa_skip;
+  uint16_t ref_len;
+  volatile uint32_t glitch_count;
+
+  // Grid relationship with reuse_from, ratio is 0 if nothing is reused.
+  // Pixel (i, j) reuses prev pixel ((i - base_i) / ratio, (j - base_j) / ratio)
+  int16_t reuse_ratio;
+  int16_t reuse_base_i, reuse_base_j;
+  volatile uint32_t reuse_count;
+
+  // Grid position of pixel (0, 0) in the cache, level is -1 if the cache
+  // isn't used
+  int8_t cache_level;
+  int32_t cache_base_i, cache_base_j;
+  volatile uint32_t cache_lookups;
+  volatile uint32_t cache_hits;
+
+  // Run-length encoding: the ring slot of each band being generated, the
+  // band in each slot (-1 if free) and its tiles done, whether a worker is
+  // encoding, bands and rows encoded so far, bytes of rle_data used and rows
+  // stored at reduced resolution
+  int8_t band_slot[FRACTAL_RLE_MAX_BANDS];
+  volatile int16_t slot_band[FRACTAL_RLE_RING_BANDS];
+  uint8_t slot_tiles_done[FRACTAL_RLE_RING_BANDS];
+  volatile bool encoding;
+  volatile int16_t bands_encoded;
+  int16_t rows_encoded;
+  uint32_t rle_used;
+  uint16_t rle_reduced_rows;
+
+  // Core 0 stats from generate_steal: calls that returned at once as the
+  // display was already waiting, and time spent waiting for the DMA with no
+  // tiles left to claim.
+  uint32_t steal_idle;
+  uint32_t dma_stall_us;
+
+  // Work queue.  The buffer is divided into tiles, which workers claim in
+  // order by incrementing tile_next.  done is set by whichever worker
+  // finishes the last tile.
+  int16_t tiles_x, tiles_y;
+  uint16_t num_tiles;
+  volatile uint16_t tile_next;
+  volatile uint16_t tiles_done;
+
+  // Passes completed, so that a progressive buffer can be displayed before
+  // it is done - see fractal_progressive_pixel.  Progressive tiles are
+  // bands of 8 rows, ordered by pass.
+  volatile uint8_t passes_done;
+  uint16_t pass_tiles_done[FRACTAL_PASSES];
+  FractalWorker workers[FRACTAL_MAX_WORKERS];
 } FractalBuffer;
 
+// Offset of pixel (i, j) in buff.  For FRACTAL_LAYOUT_RLE, only rows of
+// bands still being generated are in buff - see fractal_rle_row.
+static inline uint32_t fractal_pixel_index(const FractalBuffer* f, int16_t i, int16_t j)
+{
+  if (f->layout == FRACTAL_LAYOUT_ROW_MAJOR) return i * f->cols + j;
+  if (f->layout == FRACTAL_LAYOUT_RLE) {
+    int16_t slot = f->band_slot[i / FRACTAL_RLE_BAND_ROWS];
+    return (slot * FRACTAL_RLE_BAND_ROWS + i % FRACTAL_RLE_BAND_ROWS) * f->cols + j;
+  }
+  uint32_t tiles_per_row = (f->cols + 7) >> 3;
+  return (((i >> 3) * tiles_per_row + (j >> 3)) << 6) + ((i & 7) << 3) + (j & 7);
+}
+
+// Only for buffers without iter16
+static inline uint8_t* fractal_pixel_ptr(const FractalBuffer* f, int16_t i, int16_t j)
+{
+  return f->buff + fractal_pixel_index(f, i, j);
+}
+
+static inline uint16_t fractal_pixel(const FractalBuffer* f, int16_t i, int16_t j)
+{
+  uint32_t index = fractal_pixel_index(f, i, j);
+  if (f->iter16) return ((const uint16_t*)f->buff)[index];
+  return f->buff[index];
+}
+
+static inline void fractal_set_pixel(FractalBuffer* f, uint32_t index, uint16_t value)
+{
+  if (f->iter16) ((uint16_t*)f->buff)[index] = value;
+  else f->buff[index] = value;
+}
+
+// Pixel (i, j) approximated from the first passes of a progressive
+// generation, by the nearest generated pixel above and to the left.
+// passes must be at least 1.
+static inline uint16_t fractal_progressive_pixel(const FractalBuffer* f, uint8_t passes, int16_t i, int16_t j)
+{
+  int16_t row_shift = (8 - passes) >> 1;
+  int16_t col_shift = (7 - passes) >> 1;
+  return fractal_pixel(f, (i >> row_shift) << row_shift, (j >> col_shift) << col_shift);
+}
+
 // Make a fixed_pt_t from an int or float.
 fixed_pt_t make_fixed(int32_t x);
 fixed_pt_t make_fixedf(float x);
@@ -34,7 +370,65 @@ fixed_pt_t make_fixedf(float x);
 // Generate a section of the fractal into buff
 // Result written to buff is 0 for inside Mandelbrot set
 // Otherwise iteration of escape minus min_iter (clamped to 1)
+// Work is shared between workers in tiles, and done is set once every tile
+// has been generated.
 void init_fractal(FractalBuffer* fractal);
+
+// Snap the viewport of fractal so its pixel step is 1/ratio of prev's and
+// every ratio'th sample coincides with one in prev, so that init_fractal can
+// set up reuse.  The centre moves by up to half a pixel.  The viewport is
+// left alone if prev's step can't be divided exactly.
+// With prev NULL, the viewport is instead adjusted slightly to start a
+// sequence of zooms whose steps can be divided by ratio many times.
+void snap_fractal_viewport(FractalBuffer* fractal, const FractalBuffer* prev, int16_t ratio);
+
+// Set up a tile cache in an arena of num_tiles tiles, indexed by
+// num_buckets bucket heads, which must be a power of 2.
+void fractal_cache_init(FractalCache* cache, FractalCacheTile* tiles, uint16_t num_tiles,
+                        uint16_t* buckets, uint16_t num_buckets);
+
+// Snap the viewport of fractal to the nearest cache level and grid,
+// keeping its centre.  Pixels are made square.  Views outside the range
+// of levels are left alone.
+void fractal_cache_snap_viewport(FractalBuffer* fractal);
+
+// Once fractal is done, add the tiles it covers completely to its cache,
+// replacing any already cached.  If the arena is full, the tiles least
+// recently in a stored view are evicted.
+void fractal_cache_store(FractalBuffer* fractal);
+
+static inline uint32_t fractal_cache_bytes_used(const FractalCache* cache)
+{
+  return cache->tiles_used * sizeof(FractalCacheTile);
+}
+
+// Decode row i of a FRACTAL_LAYOUT_RLE buffer that is done into cols bytes
+// at row
+void fractal_rle_row(const FractalBuffer* fractal, int16_t i, uint8_t* row);
+
+// Generate tiles as the given worker until there are none left to claim
+void generate_worker(FractalBuffer* f, int worker);
+
+// Worker 0, run on core 1
 void generate_fractal(FractalBuffer* fractal);
-void generate_steal(FractalBuffer* f, uint dma_to_check);
+
+// Choose max_iter and iter_offset for the next generation into f from the
+// escape histogram built while prev was generated, without another pass
+// over its pixels, which may not even be kept.  max_iter grows while many
+// pixels escape just below it and shrinks while the top of the window is
+// unused, within
+// [min_max_iter, max_max_iter].  iter_offset follows the lowest escape, and
+// keeps the window within 8 bits unless f->iter16 is set.
+void choose_iteration_window(FractalBuffer* f, const FractalBuffer* prev, uint16_t min_max_iter, uint16_t max_max_iter);
+
+// Equalise a palette over the escape histogram of generated buffer f: each
+// bin b gets in entries[b] the colour from 1 to colours at the middle of its
+// share of the escaped pixels.  Returns false if no pixels escaped.
+bool fractal_equalise_histogram(const FractalBuffer* f, uint16_t colours, uint16_t* entries);
+
+// Worker 1, run on core 0.  generate_steal generates while the display
+// channel is busy, generate_steal_until_done finishes any tile already
+// claimed and helps with the rest.
+struct DisplayBackend;
+void generate_steal(FractalBuffer* f, struct DisplayBackend* display, uint chan_idx);
 void generate_steal_until_done(FractalBuffer* f);
@@ -0,0 +1,89 @@
+#include "pico/stdlib.h"
+#include "hardware/interp.h"
+
+#include "mandelbrot.h"
+#include "scaler.h"
+
+void scale_init()
+{
+#if PICO_ON_DEVICE
+  // Lane 1 result is base 0 blended towards base 1 by accum 1 / 256
+  interp_config cfg = interp_default_config();
+  interp_config_set_blend(&cfg, true);
+  interp_set_config(interp0, 0, &cfg);
+  cfg = interp_default_config();
+  interp_config_set_signed(&cfg, true);
+  interp_set_config(interp0, 1, &cfg);
+#endif
+}
+
+// a + (b - a) * alpha / 256
+static inline uint32_t blend(uint32_t a, uint32_t b, uint32_t alpha)
+{
+#if PICO_ON_DEVICE
+  interp0->base[0] = a;
+  interp0->base[1] = b;
+  interp0->accum[1] = alpha;
+  return interp0->peek[1];
+#else
+  return a + (((int32_t)(b - a) * (int32_t)alpha) >> 8);
+#endif
+}
+
+// Escape count with 8 fraction bits
+static inline uint32_t sample(const FractalBuffer* f, uint32_t index, bool iter16, bool smooth)
+{
+  uint32_t k = iter16 ? ((const uint16_t*)f->buff)[index] : f->buff[index];
+  return (k << 8) | (smooth ? f->smooth[index] : 0);
+}
+
+// Specialised by the callers for the pixel format
+static inline __attribute__((always_inline))
+void scale_row(const FractalBuffer* f, const uint16_t* palette, uint8_t palette_bits,
+               int32_t y, int32_t x, int32_t x_step, int count, uint16_t* pixels,
+               bool iter16, bool smooth)
+{
+  const bool row_major = f->layout == FRACTAL_LAYOUT_ROW_MAJOR;
+  const int shift = 8 - palette_bits;
+  int16_t i0 = y >> SCALE_FIXED_PT;
+  int16_t i1 = MIN(i0 + 1, f->rows - 1);
+  uint32_t fy = (y >> (SCALE_FIXED_PT - 8)) & 0xff;
+  uint32_t row0 = fractal_pixel_index(f, i0, 0);
+  uint32_t row1 = fractal_pixel_index(f, i1, 0);
+
+  for (int n = 0; n < count; ++n, x += x_step) {
+    int16_t j0 = x >> SCALE_FIXED_PT;
+    int16_t j1 = MIN(j0 + 1, f->cols - 1);
+    uint32_t fx = (x >> (SCALE_FIXED_PT - 8)) & 0xff;
+
+    uint32_t a = sample(f, row_major ? row0 + j0 : fractal_pixel_index(f, i0, j0), iter16, smooth);
+    if (a == 0) {
+      *pixels++ = palette[0];
+      continue;
+    }
+    uint32_t b = sample(f, row_major ? row0 + j1 : fractal_pixel_index(f, i0, j1), iter16, smooth);
+    uint32_t c = sample(f, row_major ? row1 + j0 : fractal_pixel_index(f, i1, j0), iter16, smooth);
+    uint32_t d = sample(f, row_major ? row1 + j1 : fractal_pixel_index(f, i1, j1), iter16, smooth);
+
+    // Blend inside samples as if they were the same as a
+    if (b == 0) b = a;
+    if (c == 0) c = a;
+    if (d == 0) d = a;
+
+    uint32_t top = blend(a, b, fx);
+    uint32_t bottom = blend(c, d, fx);
+    *pixels++ = palette[blend(top, bottom, fy) >> shift];
+  }
+}
+
+void scale_row_bilinear(const FractalBuffer* f, const uint16_t* palette, uint8_t palette_bits,
+                        int32_t y, int32_t x, int32_t x_step, int count, uint16_t* pixels)
+{
+  if (f->iter16) {
+    if (f->smooth) scale_row(f, palette, palette_bits, y, x, x_step, count, pixels, true, true);
+    else scale_row(f, palette, palette_bits, y, x, x_step, count, pixels, true, false);
+  } else {
+    if (f->smooth) scale_row(f, palette, palette_bits, y, x, x_step, count, pixels, false, true);
+    else scale_row(f, palette, palette_bits, y, x, x_step, count, pixels, false, false);
+  }
+}
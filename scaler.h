@@ -0,0 +1,16 @@
+// Scaling of an iteration buffer to RGB565 display rows.
+// Include after mandelbrot.h.
+
+// Fixed point for positions in the buffer, in pixels
+#define SCALE_FIXED_PT 16
+
+// Set up the interpolator of the calling core for scale_row_bilinear
+void scale_init();
+
+// Fill count pixels of a display row from row y of f, starting at column
+// x and stepping by x_step, blending the four samples around each position.
+// Samples are blended as escape counts, including any smooth fraction, and
+// then looked up in palette, which has 1 << palette_bits entries per count.
+// Samples inside the set aren't blended.
+void scale_row_bilinear(const FractalBuffer* f, const uint16_t* palette, uint8_t palette_bits,
+                        int32_t y, int32_t x, int32_t x_step, int count, uint16_t* pixels);
@@ -13,6 +13,8 @@
 #include "hardware/dma.h"
 
 #include "st7789_lcd.pio.h"
+#include "display.h"
+#include "st7789_lcd.h"
 
 #define SCREEN_WIDTH 240
 #define SCREEN_HEIGHT 240
@@ -24,8 +26,6 @@
 #define PIN_RESET 4
 #define PIN_BL 5
 
-#define SERIAL_CLK_DIV 2.f
-
 // Format: cmd length (including cmd byte), post delay in units of 5 ms, then cmd payload
 // Note the delays have been shortened a little
 static const uint8_t st7789_init_seq[] = {
@@ -63,7 +63,7 @@ static inline void lcd_write_cmd(PIO pio, uint sm, const uint8_t *cmd, size_t co
 
 void st7789_init(PIO pio, uint sm) {
     uint offset = pio_add_program(pio, &st7789_lcd_program);
-    st7789_lcd_program_init(pio, sm, offset, PIN_DIN, PIN_CLK, SERIAL_CLK_DIV);
+    st7789_lcd_program_init(pio, sm, offset, PIN_DIN, PIN_CLK, ST7789_SERIAL_CLK_DIV);
 
     gpio_init(PIN_CS);
     gpio_init(PIN_DC);
@@ -90,16 +90,16 @@ void st7789_init(PIO pio, uint sm) {
 void st7789_start_pixels(PIO pio, uint sm) {
     uint8_t cmd = 0x2c; // RAMWR
     st7789_lcd_wait_idle(pio, sm);
-    st7789_set_pixel_mode(pio, sm, false);
+    st7789_set_pull_threshold(pio, sm, 8);
     lcd_write_cmd(pio, sm, &cmd, 1);
-    st7789_set_pixel_mode(pio, sm, true);
+    st7789_set_pull_threshold(pio, sm, ST7789_PULL_BITS);
     lcd_set_dc_cs(1, 0);
 }
 
 void st7789_stop_pixels(PIO pio, uint sm) {
     st7789_lcd_wait_idle(pio, sm);
     lcd_set_dc_cs(1, 1);
-    st7789_set_pixel_mode(pio, sm, false);
+    st7789_set_pull_threshold(pio, sm, 8);
 }
 
 void st7789_create_dma_channels(PIO pio, uint sm, uint chan[2])
@@ -108,7 +108,8 @@ void st7789_create_dma_channels(PIO pio, uint sm, uint chan[2])
   chan[1] = dma_claim_unused_channel(true);
 
   dma_channel_config c = dma_channel_get_default_config(chan[0]);
-  channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+  channel_config_set_transfer_data_size(&c, ST7789_PIXELS_PER_WORD == 2 ? DMA_SIZE_32 : DMA_SIZE_16);
+  channel_config_set_bswap(&c, ST7789_DMA_BSWAP);
   channel_config_set_dreq(&c, pio_get_dreq(pio, sm, true));
   channel_config_set_read_increment(&c, true);
   channel_config_set_write_increment(&c, false);
@@ -123,7 +124,8 @@ void st7789_create_dma_channels(PIO pio, uint sm, uint chan[2])
     );
 
   c = dma_channel_get_default_config(chan[1]);
-  channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+  channel_config_set_transfer_data_size(&c, ST7789_PIXELS_PER_WORD == 2 ? DMA_SIZE_32 : DMA_SIZE_16);
+  channel_config_set_bswap(&c, ST7789_DMA_BSWAP);
   channel_config_set_dreq(&c, pio_get_dreq(pio, sm, true));
   channel_config_set_read_increment(&c, true);
   channel_config_set_write_increment(&c, false);
@@ -166,7 +168,7 @@ void st7789_dma_pixels(uint chan[2], uint chan_idx, const uint16_t* pixels, uint
   dma_channel_wait_for_finish_blocking(this_chan);
 
   dma_channel_hw_addr(this_chan)->read_addr = (uintptr_t)pixels;
-  dma_channel_hw_addr(this_chan)->transfer_count = num_pixels;
+  dma_channel_hw_addr(this_chan)->transfer_count = num_pixels / ST7789_PIXELS_PER_WORD;
   uint ctrl = dma_channel_hw_addr(this_chan)->ctrl_trig;
   ctrl &= ~DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS;
   ctrl |= DMA_CH0_CTRL_TRIG_INCR_READ_BITS | (this_chan << DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB);
@@ -174,7 +176,8 @@ void st7789_dma_pixels(uint chan[2], uint chan_idx, const uint16_t* pixels, uint
   st7789_chain_or_trigger(this_chan, other_chan, ctrl);
 }
 
-static uint32_t pixel_to_dma;
+// One per channel, as the other channel may still be sending its pixel
+static uint32_t pixel_to_dma[2];
 
 void st7789_dma_repeat_pixel(uint chan[2], uint chan_idx, uint16_t pixel, uint repeats)
 {
@@ -183,12 +186,65 @@ void st7789_dma_repeat_pixel(uint chan[2], uint chan_idx, uint16_t pixel, uint r
 
   dma_channel_wait_for_finish_blocking(this_chan);
 
-  pixel_to_dma = pixel;
-  dma_channel_hw_addr(this_chan)->read_addr = (uintptr_t)&pixel_to_dma;
-  dma_channel_hw_addr(this_chan)->transfer_count = repeats;
+  // A 16-bit read takes the low half
+  pixel_to_dma[chan_idx] = pixel | ((uint32_t)pixel << 16);
+  dma_channel_hw_addr(this_chan)->read_addr = (uintptr_t)&pixel_to_dma[chan_idx];
+  dma_channel_hw_addr(this_chan)->transfer_count = repeats / ST7789_PIXELS_PER_WORD;
   uint ctrl = dma_channel_hw_addr(this_chan)->ctrl_trig;
   ctrl &= ~(DMA_CH0_CTRL_TRIG_INCR_READ_BITS | DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS);
   ctrl |= this_chan << DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB;
 
   st7789_chain_or_trigger(this_chan, other_chan, ctrl);
 }
+
+static void display_start_pixels(DisplayBackend* d)
+{
+  St7789Display* lcd = d->state;
+  st7789_start_pixels(lcd->pio, lcd->sm);
+}
+
+static void display_stop_pixels(DisplayBackend* d)
+{
+  St7789Display* lcd = d->state;
+  st7789_stop_pixels(lcd->pio, lcd->sm);
+}
+
+static void display_send_pixels(DisplayBackend* d, uint chan_idx, const uint16_t* pixels, uint num_pixels)
+{
+  St7789Display* lcd = d->state;
+  st7789_dma_pixels(lcd->chan, chan_idx, pixels, num_pixels);
+}
+
+static void display_repeat_pixel(DisplayBackend* d, uint chan_idx, uint16_t pixel, uint repeats)
+{
+  St7789Display* lcd = d->state;
+  st7789_dma_repeat_pixel(lcd->chan, chan_idx, pixel, repeats);
+}
+
+static bool display_is_busy(DisplayBackend* d, uint chan_idx)
+{
+  St7789Display* lcd = d->state;
+  return dma_channel_is_busy(lcd->chan[chan_idx]);
+}
+
+static void display_wait_for_finish(DisplayBackend* d, uint chan_idx)
+{
+  St7789Display* lcd = d->state;
+  dma_channel_wait_for_finish_blocking(lcd->chan[chan_idx]);
+}
+
+void st7789_display_init(DisplayBackend* d, St7789Display* lcd, PIO pio, uint sm)
+{
+  lcd->pio = pio;
+  lcd->sm = sm;
+  st7789_init(pio, sm);
+  st7789_create_dma_channels(pio, sm, lcd->chan);
+
+  d->start_pixels = display_start_pixels;
+  d->stop_pixels = display_stop_pixels;
+  d->send_pixels = display_send_pixels;
+  d->repeat_pixel = display_repeat_pixel;
+  d->is_busy = display_is_busy;
+  d->wait_for_finish = display_wait_for_finish;
+  d->state = lcd;
+}
@@ -1,3 +1,33 @@
+// Send pixels two to each 32-bit PIO FIFO word, rather than one per word
+// with the other half wasted, so the DMA makes half as many transfers.
+// Pixel rows must then be word aligned with an even number of pixels, and
+// hold colours converted by st7789_pixel.  Comment out for 16-bit transfers.
+#define ST7789_PACKED_PIXELS
+
+#ifdef ST7789_PACKED_PIXELS
+#define ST7789_PIXELS_PER_WORD 2
+#else
+#define ST7789_PIXELS_PER_WORD 1
+#endif
+
+// The PIO shifts each FIFO word out MSB first, so packed words are read by
+// the DMA with their bytes swapped to put the first pixel on top.
+#define ST7789_PULL_BITS (16 * ST7789_PIXELS_PER_WORD)
+#define ST7789_DMA_BSWAP (ST7789_PIXELS_PER_WORD == 2)
+
+// System clocks per PIO cycle.  The program takes two cycles per bit, so
+// at 133MHz the default of 2 gives a 33MHz serial clock.
+#ifndef ST7789_SERIAL_CLK_DIV
+#define ST7789_SERIAL_CLK_DIV 2.f
+#endif
+
+// RGB565 colour as it is stored in pixel rows.  Byte swapping the packed
+// words swaps the bytes of each pixel too, so they're stored swapped.
+static inline uint16_t st7789_pixel(uint16_t colour)
+{
+  return ST7789_DMA_BSWAP ? (uint16_t)((colour >> 8) | (colour << 8)) : colour;
+}
+
 void st7789_init(PIO pio, uint sm);
 void st7789_start_pixels(PIO pio, uint sm);
 void st7789_stop_pixels(PIO pio, uint sm);
@@ -5,4 +35,12 @@ void st7789_create_dma_channels(PIO pio, uint sm, uint chan[2]);
 void st7789_dma_pixels(uint chan[2], uint chan_idx, const uint16_t* pixels, uint num_pixels);
 void st7789_dma_repeat_pixel(uint chan[2], uint chan_idx, uint16_t pixel, uint repeats);
 
-#include "st7789_lcd.pio.h"
+// The display as a DisplayBackend, with a DMA channel for each of its
+// channels
+typedef struct {
+  PIO pio;
+  uint sm;
+  uint chan[2];
+} St7789Display;
+
+void st7789_display_init(DisplayBackend* d, St7789Display* lcd, PIO pio, uint sm);
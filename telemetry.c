@@ -0,0 +1,151 @@
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "mandelbrot.h"
+#include "telemetry.h"
+
+#define TELEMETRY_MAGIC0 0xa5
+#define TELEMETRY_MAGIC1 0x5a
+
+static TelemetryRecord ring[TELEMETRY_RING_SIZE];
+static uint16_t ring_head, ring_tail;  // Records pushed and read, mod 65536
+static uint16_t sequence;
+static uint16_t dropped;
+
+// Frame being read out, and the bytes of it already read
+static uint8_t read_frame[TELEMETRY_FRAME_SIZE];
+static int read_pos = TELEMETRY_FRAME_SIZE;
+
+void telemetry_fill(TelemetryRecord* r, const FractalBuffer* f)
+{
+  r->max_iter = f->max_iter;
+  r->iter_offset = f->iter_offset;
+  r->pixels_core0 = f->workers[1].pixels;
+  r->pixels_core1 = f->workers[0].pixels;
+  r->iterations = f->iterations;
+  r->cycle_iters_saved = f->cycle_iters_saved;
+  r->steal_idle = f->steal_idle;
+  r->dma_stall_us = f->dma_stall_us;
+}
+
+void telemetry_push(TelemetryRecord* r)
+{
+  r->sequence = sequence++;
+  if ((uint16_t)(ring_head - ring_tail) == TELEMETRY_RING_SIZE) {
+    dropped++;
+    return;
+  }
+  r->dropped = dropped;
+  dropped = 0;
+  ring[ring_head++ % TELEMETRY_RING_SIZE] = *r;
+}
+
+int telemetry_read(uint8_t* buff, int max)
+{
+  int n = 0;
+  while (n < max) {
+    if (read_pos == TELEMETRY_FRAME_SIZE) {
+      if (ring_tail == ring_head) break;
+      telemetry_encode(&ring[ring_tail++ % TELEMETRY_RING_SIZE], read_frame);
+      read_pos = 0;
+    }
+    int len = MIN(max - n, TELEMETRY_FRAME_SIZE - read_pos);
+    memcpy(buff + n, read_frame + read_pos, len);
+    read_pos += len;
+    n += len;
+  }
+  return n;
+}
+
+uint16_t telemetry_checksum(const uint8_t* data, int len)
+{
+  uint16_t a = 0, b = 0;
+  for (int i = 0; i < len; ++i) {
+    a = (a + data[i]) % 255;
+    b = (b + a) % 255;
+  }
+  return (b << 8) | a;
+}
+
+static uint8_t* put16(uint8_t* p, uint16_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  return p + 2;
+}
+
+static uint8_t* put32(uint8_t* p, uint32_t v)
+{
+  return put16(put16(p, v), v >> 16);
+}
+
+static const uint8_t* get16(const uint8_t* p, uint16_t* v)
+{
+  *v = p[0] | (p[1] << 8);
+  return p + 2;
+}
+
+static const uint8_t* get32(const uint8_t* p, uint32_t* v)
+{
+  uint16_t lo, hi;
+  p = get16(get16(p, &lo), &hi);
+  *v = lo | ((uint32_t)hi << 16);
+  return p;
+}
+
+void telemetry_encode(const TelemetryRecord* r, uint8_t* frame)
+{
+  frame[0] = TELEMETRY_MAGIC0;
+  frame[1] = TELEMETRY_MAGIC1;
+  frame[2] = TELEMETRY_VERSION;
+  frame[3] = TELEMETRY_PAYLOAD_SIZE;
+  uint8_t* p = frame + 4;
+  p = put16(p, r->sequence);
+  p = put16(p, r->dropped);
+  p = put32(p, r->generate_us);
+  p = put32(p, r->display_us);
+  p = put16(p, r->frames);
+  p = put16(p, r->max_iter);
+  p = put16(p, r->iter_offset);
+  p = put32(p, r->pixels_core0);
+  p = put32(p, r->pixels_core1);
+  p = put32(p, r->iterations);
+  p = put32(p, r->cycle_iters_saved);
+  p = put32(p, r->steal_idle);
+  p = put32(p, r->dma_stall_us);
+  p = put16(p, r->clamps);
+  p = put32(p, r->border_rows);
+  put16(p, telemetry_checksum(frame + 2, TELEMETRY_PAYLOAD_SIZE + 2));
+}
+
+int telemetry_decode(const uint8_t* data, int len, TelemetryRecord* r)
+{
+  for (int i = 0; i + TELEMETRY_FRAME_SIZE <= len; ++i) {
+    const uint8_t* frame = data + i;
+    if (frame[0] != TELEMETRY_MAGIC0 || frame[1] != TELEMETRY_MAGIC1 ||
+        frame[2] != TELEMETRY_VERSION || frame[3] != TELEMETRY_PAYLOAD_SIZE) continue;
+
+    uint16_t checksum;
+    get16(frame + 4 + TELEMETRY_PAYLOAD_SIZE, &checksum);
+    if (checksum != telemetry_checksum(frame + 2, TELEMETRY_PAYLOAD_SIZE + 2)) continue;
+
+    const uint8_t* p = frame + 4;
+    p = get16(p, &r->sequence);
+    p = get16(p, &r->dropped);
+    p = get32(p, &r->generate_us);
+    p = get32(p, &r->display_us);
+    p = get16(p, &r->frames);
+    p = get16(p, &r->max_iter);
+    p = get16(p, &r->iter_offset);
+    p = get32(p, &r->pixels_core0);
+    p = get32(p, &r->pixels_core1);
+    p = get32(p, &r->iterations);
+    p = get32(p, &r->cycle_iters_saved);
+    p = get32(p, &r->steal_idle);
+    p = get32(p, &r->dma_stall_us);
+    p = get16(p, &r->clamps);
+    get32(p, &r->border_rows);
+    return i + TELEMETRY_FRAME_SIZE;
+  }
+  return 0;
+}
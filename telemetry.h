@@ -0,0 +1,52 @@
+// Per-generation telemetry, kept in a ring and sent over UART as framed
+// binary records.  host/telemetry_decode turns the stream into CSV.
+// Include after mandelbrot.h.
+
+#define TELEMETRY_VERSION 2
+
+// Records held until they are read out.  More are dropped and counted.
+#define TELEMETRY_RING_SIZE 32
+
+// Frames are 0xa5 0x5a, version, payload length, the payload in little
+// endian order, and a Fletcher-16 checksum of version, length and payload.
+#define TELEMETRY_PAYLOAD_SIZE 48
+#define TELEMETRY_FRAME_SIZE (TELEMETRY_PAYLOAD_SIZE + 6)
+
+typedef struct {
+  uint16_t sequence;     // Set by telemetry_push, counts every record pushed
+  uint16_t dropped;      // Set by telemetry_push, records dropped since the last one sent
+  uint32_t generate_us;  // Time core 1 took to generate the buffer
+  uint32_t display_us;   // Time spent displaying frames while it was generated
+  uint16_t frames;       // Frames displayed while it was generated
+  uint16_t max_iter;
+  uint16_t iter_offset;
+  uint32_t pixels_core0;
+  uint32_t pixels_core1;
+  uint32_t iterations;
+  uint32_t cycle_iters_saved;
+  uint32_t steal_idle;
+  uint32_t dma_stall_us;
+  uint16_t clamps;       // Frames where panning was stopped at the edge of the buffer
+  uint32_t border_rows;  // Display rows not wholly inside the buffer displayed
+} TelemetryRecord;
+
+// Fill the fields of r that come from a generated buffer
+void telemetry_fill(TelemetryRecord* r, const FractalBuffer* f);
+
+// Add r to the ring, or count it as dropped if the ring is full
+void telemetry_push(TelemetryRecord* r);
+
+// Copy up to max bytes of framed records from the ring to buff, returning
+// the number copied.  Doesn't block, and frames can be split across calls.
+int telemetry_read(uint8_t* buff, int max);
+
+// Frame r into frame, which must hold TELEMETRY_FRAME_SIZE bytes
+void telemetry_encode(const TelemetryRecord* r, uint8_t* frame);
+
+// Decode the first valid frame in data into r, returning the number of
+// bytes up to the end of it.  Returns 0 if there is no complete frame, in
+// which case all but the last TELEMETRY_FRAME_SIZE - 1 bytes can be discarded.
+int telemetry_decode(const uint8_t* data, int len, TelemetryRecord* r);
+
+// Fletcher-16 checksum of len bytes, as ends each frame
+uint16_t telemetry_checksum(const uint8_t* data, int len);